@@ -0,0 +1,150 @@
+// Microbenchmark of the random number generators in rng.h against the
+// std::mt19937_64 based generator they replaced. Reports the time per float,
+// the cost of starting a new stream (once per pixel sample in the renderer)
+// and the mean of the generated numbers as a sanity check.
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+
+#include "rng.h"
+#include "timer.h"
+
+namespace {
+
+// The previous Rng of the renderer
+class Mt19937Rng {
+public:
+    Mt19937Rng(uint64_t seed = 1234) : rng_(seed)
+    { }
+
+    float randomFloat()
+    {
+        return distFloat_(rng_);
+    }
+
+private:
+    std::mt19937_64 rng_;
+    std::uniform_real_distribution<float> distFloat_;
+};
+
+constexpr int64_t floatCount = 1 << 26;
+constexpr int64_t streamCount = 1 << 20;
+// Floats drawn from a stream in the seeding benchmark, about a path
+constexpr int32_t floatsPerStream = 16;
+
+struct Result {
+    double nsPerFloat;
+    double mean;
+};
+
+template <typename TRng>
+Result benchFloats(TRng& rng)
+{
+    Timer timer;
+    timer.start();
+    // Independent sums, so that the adds don't bound the loop
+    double sum[4] = { 0.0, 0.0, 0.0, 0.0 };
+    for (int64_t i = 0; i < floatCount; i += 4) {
+        sum[0] += rng.randomFloat();
+        sum[1] += rng.randomFloat();
+        sum[2] += rng.randomFloat();
+        sum[3] += rng.randomFloat();
+    }
+    auto ns = (double)timer.elapsed().count();
+    return { ns / floatCount, (sum[0] + sum[1] + sum[2] + sum[3]) / floatCount };
+}
+
+Result benchFloats8(Xoshiro128Plus8& rng)
+{
+    Timer timer;
+    timer.start();
+    auto sum = Vector8(0.0f);
+    for (int64_t i = 0; i < floatCount / 8; ++i) {
+        sum += rng.randomFloat();
+    }
+    auto ns = (double)timer.elapsed().count();
+    double total = 0.0;
+    for (int i = 0; i < 8; ++i) {
+        total += sum[i];
+    }
+    return { ns / floatCount, total / floatCount };
+}
+
+// Seeds a new generator for every stream, the way the sampler starts a pixel
+// sample
+template <typename TCreate>
+double benchStreams(TCreate create)
+{
+    Timer timer;
+    timer.start();
+    float sum = 0.0f;
+    for (int64_t i = 0; i < streamCount; ++i) {
+        auto rng = create((uint64_t)i);
+        for (int32_t j = 0; j < floatsPerStream; ++j) {
+            sum += rng.randomFloat();
+        }
+    }
+    auto ns = (double)timer.elapsed().count();
+    // Keep the sum alive
+    if (sum < 0.0f)
+        printf("%f\n", sum);
+    return ns / streamCount;
+}
+
+void printResult(const char* name, const Result& result, double nsPerStream)
+{
+    if (nsPerStream > 0.0) {
+        printf("%-16s %8.3f ns/float %10.1f ns/stream   mean %.5f\n", name,
+            result.nsPerFloat, nsPerStream, result.mean);
+    } else {
+        printf("%-16s %8.3f ns/float %10s ns/stream   mean %.5f\n", name,
+            result.nsPerFloat, "-", result.mean);
+    }
+}
+
+// Generators whose draws cost the same as another row, only their stream
+// start differs
+void printStreamResult(const char* name, double nsPerStream)
+{
+    printf("%-16s %8s ns/float %10.1f ns/stream\n", name, "-", nsPerStream);
+}
+
+} // namespace
+
+int main()
+{
+    printf("%lld floats, %lld streams of %d floats\n", (long long)floatCount,
+        (long long)streamCount, floatsPerStream);
+
+    Mt19937Rng mt;
+    printResult("mt19937_64", benchFloats(mt), benchStreams([](uint64_t i) {
+        return Mt19937Rng(i);
+    }));
+
+    Pcg32 pcg;
+    printResult("pcg32", benchFloats(pcg), benchStreams([](uint64_t i) {
+        Pcg32 rng;
+        rng.setSequence(i, 0x5eed);
+        return rng;
+    }));
+
+    // Stream start of the independent sampler, a sequence per pixel and a
+    // jump to the sample. The draws after the jump are plain pcg32 draws.
+    printStreamResult("pcg32 advance", benchStreams([](uint64_t i) {
+        Pcg32 rng;
+        rng.setSequence(i & 0xffff, 0x5eed);
+        rng.advance((i >> 16) << 16);
+        return rng;
+    }));
+
+    Xoshiro128Plus xoshiro;
+    printResult("xoshiro128+", benchFloats(xoshiro), benchStreams([](uint64_t i) {
+        return Xoshiro128Plus(i);
+    }));
+
+    Xoshiro128Plus8 xoshiro8;
+    printResult("xoshiro128+ x8", benchFloats8(xoshiro8), 0.0);
+
+    return 0;
+}
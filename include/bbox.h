@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <limits>
 
+#include "platform.h"
 #include "vector.h"
 
 struct BBox {
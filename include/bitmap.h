@@ -46,7 +46,12 @@ public:
 		buffer_[y * width_ + x] = color;
 	}
 
-	bool write(const std::string& name);
+	// Values are tone mapped unless toneMapped is false, in which case they
+	// are clamped to [0, 1]
+	bool write(const std::string& name, bool toneMapped = true);
+
+	// The bytes write() puts in the file
+	void encode(std::vector<char>* bytes, bool toneMapped = true) const;
 
 private:
 	int32_t width_;
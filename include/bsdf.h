@@ -56,9 +56,12 @@ inline bool sameHemisphere(const Vector3f& w, const Vector3f& w1)
 
 class MicrofacetDistribution {
 public:
+	virtual ~MicrofacetDistribution() { }
+
 	virtual float d(const Vector3f& wh) const = 0;
 	virtual void sample(const Vector3f& wo, Vector3f* wi,
 		float u1, float u2, float* pdf) const = 0;
+	virtual float pdf(const Vector3f& wo, const Vector3f& wi) const = 0;
 };
 
 class Blinn : public MicrofacetDistribution {
@@ -73,21 +76,55 @@ public:
 	virtual void sample(const Vector3f& wo, Vector3f* wi, float u1,
 		float u2, float* pdf) const override;
 
+	virtual float pdf(const Vector3f& wo, const Vector3f& wi) const override;
+
 private:
 	float exponent_;
 };
 
+// Concrete class of a Bsdf. Batched shading groups hits by type and calls the
+// final classes directly instead of through the virtual interface.
+enum class BsdfType : int32_t {
+	Lambertian,
+	PerfectConductor,
+	PerfectDielectric,
+	FresnelConductor,
+	FresnelDielectric,
+	TorranceSparrowConductor,
+};
+
+constexpr int32_t bsdfTypeCount = 6;
+
 class Bsdf {
 public:
+	Bsdf(BsdfType type) : type_(type)
+	{ }
+
+	virtual ~Bsdf() { }
+
+	BsdfType type() const
+	{
+		return type_;
+	}
+
 	virtual Spectrum f(const Vector3f& wo, const Vector3f& wi) const = 0;
 	virtual Spectrum sample(const Vector3f& wo, Vector3f* wi,
 		float u1, float u2, float* pdf) const = 0;
+	// Solid angle pdf of sample() returning wi, 0 for delta distributions
+	virtual float pdf(const Vector3f& wo, const Vector3f& wi) const = 0;
 	virtual bool isDelta() const = 0;
+	// Overall color of the surface, a feature for denoising
+	virtual Spectrum albedo() const = 0;
+
+private:
+	BsdfType type_;
 };
 
-class Lambertian : public Bsdf {
+class Lambertian final : public Bsdf {
 public:
-	Lambertian(const Spectrum& reflectance) : reflectance_(reflectance)
+	Lambertian(const Spectrum& reflectance)
+		: Bsdf(BsdfType::Lambertian)
+		, reflectance_(reflectance)
 	{ }
 
 	virtual Spectrum f(const Vector3f& wo, const Vector3f& wi) const override;
@@ -95,18 +132,27 @@ public:
 	virtual Spectrum sample(const Vector3f& wo, Vector3f* wi, float u1,
 		float u2, float* pdf) const override;
 
+	virtual float pdf(const Vector3f& wo, const Vector3f& wi) const override;
+
 	virtual bool isDelta() const override
 	{
 		return false;
 	}
 
+	virtual Spectrum albedo() const override
+	{
+		return reflectance_;
+	}
+
 private:
 	Spectrum reflectance_;
 };
 
-class PerfectConductor : public Bsdf {
+class PerfectConductor final : public Bsdf {
 public:
-	PerfectConductor(const Spectrum& reflectance) : reflectance_(reflectance)
+	PerfectConductor(const Spectrum& reflectance)
+		: Bsdf(BsdfType::PerfectConductor)
+		, reflectance_(reflectance)
 	{ }
 
 	virtual Spectrum f(const Vector3f& wo, const Vector3f& wi) const override;
@@ -114,18 +160,26 @@ public:
 	virtual Spectrum sample(const Vector3f& wo, Vector3f* wi, float u1,
 		float u2, float* pdf) const override;
 
+	virtual float pdf(const Vector3f& wo, const Vector3f& wi) const override;
+
 	virtual bool isDelta() const override
 	{
 		return true;
 	}
+
+	virtual Spectrum albedo() const override
+	{
+		return reflectance_;
+	}
 private:
 	Spectrum reflectance_;
 };
 
-class PerfectDielectric : public Bsdf {
+class PerfectDielectric final : public Bsdf {
 public:
 	PerfectDielectric(const Spectrum& reflectance, float eta)
-		: reflectance_(reflectance)
+		: Bsdf(BsdfType::PerfectDielectric)
+		, reflectance_(reflectance)
 		, eta_(eta)
 	{ }
 
@@ -134,21 +188,29 @@ public:
 	virtual Spectrum sample(const Vector3f& wo, Vector3f* wi, float u1,
 		float u2, float* pdf) const override;
 
+	virtual float pdf(const Vector3f& wo, const Vector3f& wi) const override;
+
 	virtual bool isDelta() const override
 	{
 		return true;
 	}
 
+	virtual Spectrum albedo() const override
+	{
+		return reflectance_;
+	}
+
 private:
 	Spectrum reflectance_;
 	float eta_;
 };
 
-class FresnelConductor : public Bsdf {
+class FresnelConductor final : public Bsdf {
 public:
 	FresnelConductor(const Spectrum& reflectance, const Spectrum& eta,
 		const Spectrum& k)
-		: reflectance_(reflectance)
+		: Bsdf(BsdfType::FresnelConductor)
+		, reflectance_(reflectance)
 		, eta_(eta)
 		, k_(k)
 	{ }
@@ -158,21 +220,29 @@ public:
 	virtual Spectrum sample(const Vector3f& wo, Vector3f* wi, float u1,
 		float u2, float* pdf) const override;
 
+	virtual float pdf(const Vector3f& wo, const Vector3f& wi) const override;
+
 	virtual bool isDelta() const override
 	{
 		return true;
 	}
 
+	virtual Spectrum albedo() const override
+	{
+		return reflectance_;
+	}
+
 private:
 	Spectrum reflectance_;
 	Spectrum eta_;
 	Spectrum k_;
 };
 
-class FresnelDielectric : public Bsdf {
+class FresnelDielectric final : public Bsdf {
 public:
 	FresnelDielectric(const Spectrum& reflectance, float eta)
-		: reflectance_(reflectance)
+		: Bsdf(BsdfType::FresnelDielectric)
+		, reflectance_(reflectance)
 		, eta_(eta)
 	{ }
 
@@ -181,11 +251,18 @@ public:
 	virtual Spectrum sample(const Vector3f& wo, Vector3f* wi, float u1,
 		float u2, float* pdf) const override;
 
+	virtual float pdf(const Vector3f& wo, const Vector3f& wi) const override;
+
 	virtual bool isDelta() const override
 	{
 		return true;
 	}
 
+	virtual Spectrum albedo() const override
+	{
+		return reflectance_;
+	}
+
 private:
 	Spectrum reflectance_;
 	float eta_;
@@ -194,11 +271,12 @@ private:
 /*
  * TorranceSparrow microfacet brdf for conductors
  */
-class TorranceSparrowConductor : public Bsdf {
+class TorranceSparrowConductor final : public Bsdf {
 public:
 	TorranceSparrowConductor(const Spectrum& reflectance,
 		const Spectrum& eta, const Spectrum& k, float exponent)
-		: reflectance_(reflectance)
+		: Bsdf(BsdfType::TorranceSparrowConductor)
+		, reflectance_(reflectance)
 		, eta_(eta)
 		, k_(k)
 	{
@@ -210,11 +288,18 @@ public:
 	virtual Spectrum sample(const Vector3f& wo, Vector3f* wi,
 		float u1, float u2, float* pdf) const override;
 
+	virtual float pdf(const Vector3f& wo, const Vector3f& wi) const override;
+
 	virtual bool isDelta() const override
 	{
 		return false;
 	}
 
+	virtual Spectrum albedo() const override
+	{
+		return reflectance_;
+	}
+
 	float G(const Vector3f& wo, const Vector3f& wi, const Vector3f& wh) const;
 
 private:
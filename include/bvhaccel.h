@@ -1,6 +1,7 @@
 #if !defined(BVHACCEL_H)
 #define BVHACCEL_H
 
+#include <cstdint>
 #include <memory>
 
 #include "triaccel.h"
@@ -49,6 +50,16 @@ public:
 
     bool intersectShadow(const Ray& ray) const;
 
+    // Occlusion of a batch of rays. Rays already flagged in occluded are
+    // skipped, the others are flagged when something blocks them. Rays are
+    // traversed together in packets of up to maxPacketSize.
+    void intersectShadow(const Ray* rays, int32_t count, bool* occluded) const;
+
+    static constexpr int32_t maxPacketSize = 8;
+
+    // Memory of the nodes and the triangle copies
+    size_t memoryBytes() const;
+
 public:
     struct FlattenedBvhNode;
 
@@ -56,6 +67,7 @@ private:
 
     std::vector<FlattenedBvhNode> optimizedAccel_;
     TriAccel* triangles_;
+    size_t triangleCount_;
     const Scene& scene_;
 };
 
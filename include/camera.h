@@ -1,7 +1,10 @@
 #if !defined(CAMERA_H)
 #define CAMERA_H
 
+#include <cmath>
+
 #include "bitmap.h"
+#include "sensor.h"
 #include "vector.h"
 
 class Camera {
@@ -14,11 +17,29 @@ public:
         , width_(width)
         , height_(height)
         , fov_(fov)
-        , up_(up)
-        , sensor_(Bitmap(width_, height_))
+        , worldUp_(up)
+        , sensor_(width_, height_)
     {
-        right_ = cross(direction_, up) * (width * fov_ / height_);
-        up_ = normal(cross(right_, direction_)) * fov_;
+        updateBasis();
+    }
+
+    // Moves the camera, the samples on the sensor are left alone. direction
+    // has to be normalized.
+    void setView(const Vector3f& position, const Vector3f& direction)
+    {
+        position_ = position;
+        direction_ = direction;
+        updateBasis();
+    }
+
+    const Vector3f& getPosition() const
+    {
+        return position_;
+    }
+
+    const Vector3f& getDirection() const
+    {
+        return direction_;
     }
 
     Ray sample(float x, float y) const
@@ -45,29 +66,61 @@ public:
 		return Vector2i(width_, height_);
 	}
 
-    void accumulate(int32_t x, int32_t y, const RGBColor& color)
+    void accumulate(int32_t x, int32_t y, const Spectrum& sum,
+        float lumaSqSum, uint32_t count, const Spectrum& albedoSum,
+        const Vector3f& normalSum)
     {
-        sensor_.set(x, y, color);
+        sensor_.addSamples(x, y, sum, lumaSqSum, count, albedoSum, normalSum);
     }
 
-    void saveImage(const std::string& name)
+    const Sensor& getSensor() const
     {
-        sensor_.write(name);
+        return sensor_;
+    }
+
+    Sensor& getSensor()
+    {
+        return sensor_;
+    }
+
+    bool saveImage(const std::string& name) const
+    {
+        Bitmap bitmap(width_, height_);
+        sensor_.develop(&bitmap);
+        return bitmap.write(name);
     }
 
 private:
+    void updateBasis()
+    {
+        auto right = cross(direction_, worldUp_);
+        if (length2(right) < 1e-12f) {
+            // Looking along worldUp_, take the world axis most across the
+            // view instead
+            auto x = std::abs(direction_.x);
+            auto y = std::abs(direction_.y);
+            auto z = std::abs(direction_.z);
+            Vector3f axis(0.0f, 0.0f, 1.0f);
+            if (x <= y && x <= z)
+                axis = Vector3f(1.0f, 0.0f, 0.0f);
+            else if (y <= z)
+                axis = Vector3f(0.0f, 1.0f, 0.0f);
+            right = cross(direction_, axis);
+        }
+        right_ = normal(right) * (width_ * fov_ / height_);
+        up_ = normal(cross(right_, direction_)) * fov_;
+    }
+
     Vector3f position_;
     Vector3f direction_;
     int32_t width_;
     int32_t height_;
     float fov_;
+    Vector3f worldUp_;
     Vector3f up_;
     Vector3f right_;
 
-    // TODO: remove bitmap class (it doesn't make any sense), implement Sensor
-    // class, in it develop method which will convert the data to bitmap data
-    // and just leave the save bitmap function
-    Bitmap sensor_;
+    Sensor sensor_;
 };
 
 #endif // CAMERA_H
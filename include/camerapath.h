@@ -0,0 +1,31 @@
+#if !defined(CAMERAPATH_H)
+#define CAMERAPATH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vector.h"
+
+// Camera position and the point it looks at
+struct CameraPose {
+    Vector3f position;
+    Vector3f target;
+};
+
+// Reads a pose per line, "px py pz tx ty tz". Blank lines and lines starting
+// with # are skipped.
+bool readCameraPath(const std::string& name, std::vector<CameraPose>* poses);
+
+// Poses of frameCount frames spread evenly along the keyframes, the first and
+// last frame on the first and last keyframe. Positions and targets are
+// interpolated linearly between keyframes.
+std::vector<CameraPose> sampleCameraPath(const std::vector<CameraPose>& keyframes,
+    int32_t frameCount);
+
+// A full circle of frameCount frames around the vertical axis through center,
+// starting at the start position, every frame looking at center
+std::vector<CameraPose> turntablePath(const Vector3f& start,
+    const Vector3f& center, int32_t frameCount);
+
+#endif // CAMERAPATH_H
@@ -0,0 +1,94 @@
+#if !defined(CHECKPOINT_H)
+#define CHECKPOINT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "integrator.h"
+#include "sampler.h"
+#include "sensor.h"
+
+struct RenderSettings;
+
+// Settings a checkpoint has to be resumed with. The samples of a pixel depend
+// on the sampler and, for some samplers, the samples per pixel, so mixing
+// them would break the sample sequences.
+struct CheckpointInfo {
+    int32_t width = 0;
+    int32_t height = 0;
+    IntegratorType integrator = IntegratorType::PathTracer;
+    SamplerType sampler = SamplerType::Sobol;
+    int32_t samplesPerPixel = 0;
+    // Passes rendered before the checkpoint was taken
+    int32_t passes = 0;
+    // Index of the first sample of every pixel. Partial renders of a sample
+    // range start past 0, a pixel holds samples [firstSample, firstSample +
+    // sample count).
+    int32_t firstSample = 0;
+};
+
+CheckpointInfo checkpointInfo(const RenderSettings& settings,
+    const Sensor& sensor, int32_t passes, int32_t firstSample = 0);
+
+// Checkpoint files hold the info and the whole sensor: radiance, squared luma,
+// albedo and normal sums and the sample count of every pixel, in the byte
+// order of the machine. The same files carry the partial renders of a sample
+// range that rt --merge adds up, the sample counts weigh the sums.
+//
+// The sampler needs no state of its own, the samples of a pixel only depend
+// on its position and the sample index, which continues from the sample
+// count. Resuming at the pass boundary the checkpoint was taken at reproduces
+// the render bit for bit, as long as the integrator learns nothing across
+// passes (radiance cache, caustic photons and guiding start over).
+//
+// The file is written under a temporary name and renamed, a render killed
+// while writing leaves the previous checkpoint intact.
+bool writeCheckpoint(const std::string& name, const CheckpointInfo& info,
+    const Sensor& sensor);
+
+// Replaces the sensor with the one in the checkpoint. Fails if the file is
+// missing or damaged, or the sensor size doesn't match.
+bool readCheckpoint(const std::string& name, CheckpointInfo* info,
+    Sensor* sensor);
+
+// Reads just the info, to size the sensor of readCheckpoint
+bool readCheckpointInfo(const std::string& name, CheckpointInfo* info);
+
+// Writes checkpoints on a thread of its own. submit() copies the sensor,
+// which is cheap next to a pass, and returns, so the workers carry on with
+// the next pass while the file is written. A checkpoint submitted while the
+// previous one is still being written replaces any other waiting one.
+class CheckpointWriter {
+public:
+    explicit CheckpointWriter(const std::string& name);
+
+    // Writes the waiting checkpoint before returning
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter& copy) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter& copy) = delete;
+
+    void submit(const CheckpointInfo& info, const Sensor& sensor);
+
+    // Blocks until every submitted checkpoint is on disk
+    void flush();
+
+private:
+    void run();
+
+    std::string name_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    // Checkpoint waiting to be written
+    std::unique_ptr<Sensor> pending_;
+    CheckpointInfo pendingInfo_;
+    bool writing_;
+    bool shuttingDown_;
+    std::thread thread_;
+};
+
+#endif // CHECKPOINT_H
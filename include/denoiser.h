@@ -0,0 +1,34 @@
+#if !defined(DENOISER_H)
+#define DENOISER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "spectrum.h"
+
+class Sensor;
+
+struct DenoiseSettings {
+    // Number of filter passes, pass i uses taps 2^i pixels apart, so 5 passes
+    // cover a 61 x 61 pixel footprint
+    int32_t iterations = 5;
+    // Luminance edge stopping, in standard deviations of the pixel noise
+    float colorSigma = 4.0f;
+    // Edge stopping on the distance between normals and between albedos
+    float normalSigma = 0.3f;
+    float albedoSigma = 0.1f;
+};
+
+// Edge avoiding a-trous wavelet filter (Dammertz et al., "Edge-Avoiding
+// A-Trous Wavelet Transform for fast Global Illumination Filtering") over the
+// sensor image. Neighbours are weighted down when their albedo or normal
+// differs, or when their luminance differs by more than the noise of the
+// pixel predicts (variance guidance as in Schied et al., "Spatiotemporal
+// Variance-Guided Filtering"). Converged pixels are left nearly untouched.
+// Rows are filtered by the worker threads, 8 pixels at a time.
+//
+// Writes width * height pixels in row major order to image.
+void denoise(const Sensor& sensor, const DenoiseSettings& settings,
+    std::vector<Spectrum>* image);
+
+#endif // DENOISER_H
@@ -0,0 +1,134 @@
+#if !defined(DISTRIBUTED_H)
+#define DISTRIBUTED_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "socket.h"
+#include "tile.h"
+
+class Camera;
+class Renderer;
+class Scene;
+struct RenderSettings;
+
+struct DistributedStats {
+    // Wall clock time from listening to the last result
+    double seconds = 0.0;
+    // Workers that connected during the frame
+    int32_t workers = 0;
+    int64_t jobs = 0;
+    // Jobs handed to another worker after theirs was lost
+    int64_t lostJobs = 0;
+    // Jobs of slow workers handed out a second time at the end of the frame,
+    // the first result to arrive is kept
+    int64_t backupJobs = 0;
+};
+
+/*
+ * Splits a frame into jobs and hands them to worker processes. A job is a
+ * region of the image and a range of sample indices, the regions are a fixed
+ * tile grid and the ranges follow the passes of the render settings (see
+ * RenderSettings::samplesPerPass). A job takes the same samples wherever it is
+ * rendered, and the passes of a region are handed out in order, so the image
+ * is bit for bit the one a single process would render.
+ *
+ * Workers connect at any time and get the arguments of the render, so that
+ * they load the same scene with the same settings. Each worker is served by a
+ * thread of its own, one job at a time. Workers send a heartbeat while they
+ * render, a worker that closes its connection or stays silent for longer than
+ * the timeout is dropped and its job goes back into the queue. Once the queue
+ * is empty, idle workers take a second copy of the jobs still running, so a
+ * slow worker doesn't hold up the end of the frame.
+ */
+class Coordinator {
+public:
+    // arguments are the command line of the render, as a worker would parse
+    // it. Workers silent for workerTimeout seconds are dropped.
+    Coordinator(const std::vector<std::string>& arguments, double workerTimeout);
+
+    bool listen(const std::string& address);
+
+    // Renders the frame on the workers and adds the results to the camera
+    // sensor, returns once every job is done
+    void render(const RenderSettings& settings, Camera& camera);
+
+    const DistributedStats& getStats() const
+    {
+        return stats_;
+    }
+
+private:
+    struct Job {
+        Tile region;
+        int32_t sampleBegin;
+        int32_t sampleEnd;
+        // Workers currently rendering the job
+        int32_t running;
+        bool done;
+    };
+
+    struct Connection {
+        Socket* socket;
+        // Job the worker is rendering, -1 when it has none
+        int32_t job;
+    };
+
+    void serveWorker(Socket socket, int32_t worker);
+
+    // Waits for a job to hand out to the worker, returns -1 once all jobs
+    // are done
+    int32_t claimJob(int32_t worker);
+
+    // Gives back the job of a worker that failed it, returns false if
+    // another worker had already done the job
+    bool releaseJob(int32_t worker);
+
+    // Adds the pixels of the worker's job to the sensor unless another
+    // worker was first. Once the last job is done, drops the workers still
+    // rendering backup copies.
+    void completeJob(int32_t worker, const std::vector<char>& payload);
+
+    std::vector<std::string> arguments_;
+    double workerTimeout_;
+    Socket listener_;
+
+    Camera* camera_;
+    // Jobs of pass k are [k * tileCount_, (k + 1) * tileCount_)
+    std::vector<Job> jobs_;
+    size_t tileCount_;
+    int64_t jobsDone_;
+    std::map<int32_t, Connection> connections_;
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+
+    DistributedStats stats_;
+};
+
+// Worker side of a Coordinator connection
+class DistributedWorker {
+public:
+    // Connects to the coordinator and receives the arguments of the render
+    bool connect(const std::string& address, std::vector<std::string>* arguments);
+
+    // Renders jobs into the camera sensor and sends them back, until the
+    // coordinator is done. The sensor has to be empty. Returns false if the
+    // connection is lost.
+    bool serve(Renderer& renderer, const Scene& scene, Camera& camera);
+
+    int64_t jobCount() const
+    {
+        return jobs_;
+    }
+
+private:
+    Socket socket_;
+    int64_t jobs_ = 0;
+};
+
+#endif // DISTRIBUTED_H
@@ -0,0 +1,61 @@
+#if !defined(DISTRIBUTION_H)
+#define DISTRIBUTION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "platform.h"
+
+// Walker's alias table, samples an index proportionally to a list of weights
+// in constant time using a single random number.
+class AliasTable {
+public:
+    AliasTable() { }
+
+    // Negative weights count as zero. If all weights are zero the
+    // distribution is uniform.
+    explicit AliasTable(const std::vector<float>& weights)
+    {
+        build(weights);
+    }
+
+    void build(const std::vector<float>& weights);
+
+    // Returns the sampled index and writes its probability to pmf
+    FINLINE int32_t sample(float u, float* pmf) const
+    {
+        auto n = (int32_t)bins_.size();
+        float scaled = u * n;
+        auto idx = std::min((int32_t)scaled, n - 1);
+        const auto& bin = bins_[idx];
+        // Reuse the fractional part of the scaled sample to pick between the
+        // bin and its alias
+        if (scaled - idx >= bin.probability)
+            idx = bin.alias;
+        *pmf = pmf_[idx];
+        return idx;
+    }
+
+    float pmf(int32_t idx) const
+    {
+        return pmf_[idx];
+    }
+
+    size_t size() const
+    {
+        return bins_.size();
+    }
+
+private:
+    struct Bin {
+        // Probability of keeping the bin rather than taking the alias
+        float probability;
+        int32_t alias;
+    };
+
+    std::vector<Bin> bins_;
+    std::vector<float> pmf_;
+};
+
+#endif // DISTRIBUTION_H
@@ -0,0 +1,143 @@
+#if !defined(GUIDING_H)
+#define GUIDING_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "bbox.h"
+#include "spectrum.h"
+#include "vector.h"
+
+// Quadtree over the directions of the sphere, in the cylindrical coordinates
+// (cos theta + 1) / 2 and phi / 2 pi, which preserve area, so a density over
+// the unit square is 4 pi times the solid angle density. Every node keeps the
+// energy recorded in each of its four quadrants.
+class DirectionalTree {
+public:
+    DirectionalTree();
+
+    // Adds energy in direction to its leaf, thread safe. A single atomic add
+    // per record, the interior nodes are only updated by sumEnergy().
+    void record(const Vector3f& direction, float value);
+
+    // Sets the energy of interior quadrants to the sum of their children,
+    // required after recording before the tree is sampled or refined
+    void sumEnergy();
+
+    // Samples a direction proportionally to the recorded energy
+    Vector3f sample(float u1, float u2) const;
+
+    // Solid angle density of sample() picking the direction
+    float pdf(const Vector3f& direction) const;
+
+    float total() const;
+
+    // Tree with the same energy, with quadrants holding more than
+    // subdivideFraction of it split, to at most maxDepth levels, and with
+    // all energy cleared
+    DirectionalTree refined(float subdivideFraction, int32_t maxDepth) const;
+
+    size_t bytes() const
+    {
+        return nodes_.size() * sizeof(Node);
+    }
+
+private:
+    struct Node {
+        Node();
+        Node(const Node& copy);
+        Node& operator=(const Node& copy);
+
+        // Index of the node subdividing each quadrant, 0 for a leaf
+        uint32_t child[4];
+        std::atomic<float> energy[4];
+    };
+
+    void refineNode(const DirectionalTree& source, uint32_t sourceIndex,
+        uint32_t index, float threshold, int32_t depth, int32_t maxDepth);
+
+    std::vector<Node> nodes_;
+};
+
+/*
+ * Spatio-directional tree for path guiding (Mueller et al., "Practical Path
+ * Guiding for Efficient Light-Transport Simulation"). A binary tree splits
+ * the scene bounds into cells, cycling through the axes. Every cell learns the
+ * incident radiance of the paths passing through it in a DirectionalTree
+ * while the previous estimate is sampled from.
+ *
+ * Training happens in iterations. refine() ends one: cells that took enough
+ * samples are split, the learned trees become the sampling ones, and fresh
+ * ones are subdivided where the energy is. Recording is lock free, refining
+ * runs over the cells on the workers.
+ */
+class GuidingTree {
+public:
+    // Total memory of the trees is held under maxBytes, cells stop splitting
+    // once reached
+    GuidingTree(const BBox& bounds, size_t maxBytes);
+
+    // Index of the cell containing the point
+    uint32_t cell(const Vector3f& position) const;
+
+    // Tree to sample at the cell, nullptr before the first iteration is done
+    const DirectionalTree* samplingTree(uint32_t cell) const
+    {
+        const auto& tree = cells_[cell].sampling;
+        return tree.total() > 0.0f ? &tree : nullptr;
+    }
+
+    // Records radiance arriving at the cell from a direction. gathered is
+    // what the path collected after leaving in that direction and weight
+    // the path weight after the bounce, pdf the density of the direction.
+    void record(uint32_t cell, const Vector3f& direction,
+        const Spectrum& gathered, const Spectrum& weight, float pdf);
+
+    // Ends a training iteration, iteration counts from 0
+    void refine(int32_t iteration);
+
+    // Paths only record radiance while training
+    bool training() const
+    {
+        return training_;
+    }
+
+    void setTraining(bool training)
+    {
+        training_ = training;
+    }
+
+    size_t cellCount() const
+    {
+        return cells_.size();
+    }
+
+    size_t bytes() const;
+
+private:
+    struct SpatialNode {
+        // Children of an interior node, or the cell of a leaf in child[0]
+        uint32_t child[2];
+        bool isLeaf;
+    };
+
+    struct Cell {
+        Cell() : samples(0) { }
+        Cell(const Cell& copy);
+
+        DirectionalTree sampling;
+        DirectionalTree building;
+        std::atomic<uint32_t> samples;
+    };
+
+    void splitCells(int32_t iteration);
+
+    BBox bounds_;
+    size_t maxBytes_;
+    std::vector<SpatialNode> nodes_;
+    std::vector<Cell> cells_;
+    bool training_;
+};
+
+#endif // GUIDING_H
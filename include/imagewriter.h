@@ -0,0 +1,52 @@
+#if !defined(IMAGEWRITER_H)
+#define IMAGEWRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "bitmap.h"
+
+// Tone maps, encodes and writes images on a thread of its own, so that the
+// next frame of a sequence renders meanwhile. Images are written in the order
+// they are submitted. submit() blocks while maxPending images wait, which
+// bounds the memory a slow disk can hold up.
+class ImageWriter {
+public:
+    explicit ImageWriter(size_t maxPending = 4);
+
+    // Writes the waiting images before returning
+    ~ImageWriter();
+
+    ImageWriter(const ImageWriter& copy) = delete;
+    ImageWriter& operator=(const ImageWriter& copy) = delete;
+
+    // See Bitmap::write for toneMapped
+    void submit(const std::string& name, Bitmap bitmap, bool toneMapped = true);
+
+    // Blocks until every submitted image is on disk, returns false if any
+    // of them couldn't be written
+    bool flush();
+
+private:
+    struct Image {
+        std::string name;
+        Bitmap bitmap;
+        bool toneMapped;
+    };
+
+    void run();
+
+    size_t maxPending_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<Image> pending_;
+    bool writing_;
+    bool failed_;
+    bool shuttingDown_;
+    std::thread thread_;
+};
+
+#endif // IMAGEWRITER_H
@@ -0,0 +1,710 @@
+#if !defined(INTEGRATOR_H)
+#define INTEGRATOR_H
+
+#include <algorithm>
+#include <cstdint>
+
+#include "frame.h"
+#include "guiding.h"
+#include "light.h"
+#include "photonmap.h"
+#include "platform.h"
+#include "qmc.h"
+#include "radiancecache.h"
+#include "sampler.h"
+#include "scene.h"
+#include "spectrum.h"
+
+// Integrators compute the radiance arriving along a camera ray. They don't
+// share a virtual interface, the tile task is templated on the integrator
+// type, so that the per sample call is resolved at compile time and inlined.
+// Every integrator provides:
+//
+//     template <typename TSampler>
+//     Spectrum li(const Scene& scene, const Ray& ray, TSampler& sampler,
+//         PixelFeatures* features, uint64_t* rays) const;
+//
+// where rays is incremented for every ray traced and features receives the
+// surface seen by the ray, for the denoiser. Random numbers are drawn from
+// the sampler (see sampler.h), always in the same order for a given path.
+//
+// Batched integrators (IsBatched below) instead trace many paths at once,
+// see wavefront.h.
+
+enum class IntegratorType : int32_t {
+    PathTracer,
+    DirectLighting,
+    AmbientOcclusion,
+    Normals,
+    // Primary visibility lit from the camera, for previews
+    Headlight,
+    // Path tracer advancing a batch of paths one bounce at a time
+    Wavefront,
+};
+
+const char* integratorName(IntegratorType type);
+
+bool parseIntegrator(const char* name, IntegratorType* type);
+
+struct IntegratorSettings {
+    IntegratorType type = IntegratorType::PathTracer;
+    // Maximum number of bounces of a path
+    int32_t maxDepth = 10;
+    // Combine light and BSDF sampling of direct lighting, otherwise only
+    // lights are sampled
+    bool mis = true;
+    // Light samples per shading point of the path tracer and the direct
+    // lighting integrator, at most maxLightSamples. Their shadow rays are
+    // traced as one batch.
+    int32_t lightSamples = 1;
+    // Length of ambient occlusion rays, 0 for a tenth of the scene size
+    float aoDistance = 0.0f;
+    // Paths traced together by batched integrators
+    int32_t batchSize = 1024;
+    // Batched integrators sort secondary rays by origin and direction in runs
+    // of this many rays before tracing them, 0 traces them in path order
+    int32_t rayBinSize = 0;
+    // The path tracer ends paths at their second diffuse hit in the radiance
+    // cache (see radiancecache.h), once the cache cell there has seen
+    // cacheMinSamples paths. Cells are cacheCellSize wide, 0 for 1/128 of
+    // the scene size, and the cache takes at most cacheMegabytes of memory.
+    bool radianceCache = false;
+    float cacheCellSize = 0.0f;
+    int32_t cacheMinSamples = 32;
+    int32_t cacheMegabytes = 64;
+    // The path tracer takes caustics on Lambertian surfaces from a photon
+    // map (see photonmap.h) of causticPhotons photons emitted per pass.
+    // causticRadius is the lookup radius of the first pass, 0 for 1/500 of
+    // the scene size, causticAlpha in (0, 1) sets how fast it shrinks.
+    bool caustics = false;
+    int32_t causticPhotons = 200000;
+    float causticRadius = 0.0f;
+    float causticAlpha = 0.7f;
+    // The path tracer samples bounces off Lambertian surfaces from a learned
+    // distribution of the incident light (see guiding.h) with probability
+    // guidingFraction, from the BSDF otherwise. Training runs for
+    // guidingIterations iterations, each twice as many passes as the one
+    // before, and the guiding trees take at most guidingMegabytes.
+    bool guiding = false;
+    float guidingFraction = 0.5f;
+    int32_t guidingIterations = 5;
+    int32_t guidingMegabytes = 64;
+};
+
+// Integrators tracing batches of paths specialize this to true
+template <typename TIntegrator>
+struct IsBatched {
+    static constexpr bool value = false;
+};
+
+// Surface seen through a pixel sample, guides the denoiser. Zero when the
+// ray leaves the scene.
+struct PixelFeatures {
+    Spectrum albedo { 0.0f };
+    Vector3f normal { 0.0f };
+};
+
+// Records the features of a hit. Perfect mirrors and glass are looked
+// through, so that what they show keeps its edges, which makes the features
+// final at the first other surface. Returns true once the features are final.
+FINLINE bool recordFeatures(const RayHitInfo& isect, PixelFeatures* features)
+{
+    features->normal = isect.shadingNormal;
+    features->albedo = isect.bsdf ? isect.bsdf->albedo() : Spectrum(1.0f);
+    return !isect.bsdf || !isect.bsdf->isDelta();
+}
+
+// Orientation of a surface hit, shared by the integrators
+struct SurfaceHit {
+    Vector3f position;
+    // Shading normal facing the incoming ray
+    Vector3f nl;
+    Frame frame;
+    // Direction towards the ray origin, in the local frame
+    Vector3f wo;
+
+    SurfaceHit(const Ray& ray, const RayHitInfo& isect)
+        : position(ray.orig + (ray.dir * isect.t))
+        , nl(dot(isect.normal, ray.dir) < 0.0f
+            ? isect.shadingNormal : isect.shadingNormal * -1.0f)
+        , frame(nl)
+        , wo(frame.toLocal(-ray.dir))
+    { }
+};
+
+// Power heuristic weight of a sample taken with pdf fPdf, combined with a
+// strategy of pdf gPdf
+FINLINE float powerHeuristic(float fPdf, float gPdf)
+{
+    float f2 = fPdf * fPdf;
+    float g2 = gPdf * gPdf;
+    return f2 + g2 > 0.0f ? f2 / (f2 + g2) : 0.0f;
+}
+
+// Estimate direct lighting at a surface hit from a single light picked by the
+// scene light distribution. With mis the estimate is weighted against BSDF
+// sampling, the caller has to add the weighted emission of lights hit by BSDF
+// sampled rays. Passing one of the final Bsdf classes makes the BSDF calls
+// direct.
+template <typename TSampler, typename TBsdf>
+FINLINE Spectrum sampleOneLight(const Scene& scene, const TBsdf& bsdf,
+    const SurfaceHit& hit, TSampler& sampler, uint64_t* rays, bool mis)
+{
+    using std::abs;
+
+    // Draw all dimensions up front, so that their number doesn't depend on
+    // the outcome
+    float uLight = sampler.get1D();
+    auto u = sampler.get2D();
+
+    float lightPmf;
+    const auto* light = scene.sampleLight(hit.position, hit.nl, uLight,
+        &lightPmf);
+    if (!light)
+        return Spectrum(0.0f);
+
+    Vector3f wi;
+    float pdf;
+    float eps;
+    Vector3f sampledPosition;
+    Spectrum lightEmission = light->sample(hit.position, &wi, &pdf,
+        &sampledPosition, &eps, u.x, u.y);
+    if (pdf == 0.0f || lightEmission.isBlack())
+        return Spectrum(0.0f);
+
+    auto wiLocal = hit.frame.toLocal(wi);
+    Spectrum f = bsdf.f(hit.wo, wiLocal);
+    if (f.isBlack())
+        return Spectrum(0.0f);
+
+    auto lightRay = Ray(hit.position + wi * EPS, wi);
+    lightRay.maxT = length(hit.position - sampledPosition) - eps;
+
+    ++*rays;
+    if (scene.intersectShadow(lightRay))
+        return Spectrum(0.0f);
+
+    float weight = 1.0f;
+    if (mis && !light->isDelta())
+        weight = powerHeuristic(pdf * lightPmf, bsdf.pdf(hit.wo, wiLocal));
+
+    return f * lightEmission * (abs(dot(hit.nl, wi)) * weight / (pdf * lightPmf));
+}
+
+// Upper bound of IntegratorSettings::lightSamples
+constexpr int32_t maxLightSamples = 16;
+
+// Estimate direct lighting at a surface hit from count light samples, each
+// from a light picked by the scene light distribution. The shadow rays are
+// tested together as one batch, so that they share the BVH traversal. With
+// mis the samples are weighted against a single BSDF sample, the caller has
+// to weight emission found by BSDF sampling with count times the light pdf.
+template <typename TSampler, typename TBsdf>
+FINLINE Spectrum sampleLights(const Scene& scene, const TBsdf& bsdf,
+    const SurfaceHit& hit, TSampler& sampler, uint64_t* rays, bool mis,
+    int32_t count)
+{
+    using std::abs;
+
+    if (count <= 1)
+        return sampleOneLight(scene, bsdf, hit, sampler, rays, mis);
+
+    count = std::min(count, maxLightSamples);
+    Ray shadowRays[maxLightSamples];
+    Spectrum contributions[maxLightSamples];
+    bool occluded[maxLightSamples];
+    int32_t rayCount = 0;
+
+    for (int32_t i = 0; i < count; ++i) {
+        // Draw all dimensions up front, so that their number doesn't depend
+        // on the outcome
+        float uLight = sampler.get1D();
+        auto u = sampler.get2D();
+
+        float lightPmf;
+        const auto* light = scene.sampleLight(hit.position, hit.nl, uLight,
+            &lightPmf);
+        if (!light)
+            continue;
+
+        Vector3f wi;
+        float pdf;
+        float eps;
+        Vector3f sampledPosition;
+        Spectrum lightEmission = light->sample(hit.position, &wi, &pdf,
+            &sampledPosition, &eps, u.x, u.y);
+        if (pdf == 0.0f || lightEmission.isBlack())
+            continue;
+
+        auto wiLocal = hit.frame.toLocal(wi);
+        Spectrum f = bsdf.f(hit.wo, wiLocal);
+        if (f.isBlack())
+            continue;
+
+        float weight = 1.0f;
+        if (mis && !light->isDelta()) {
+            weight = powerHeuristic(count * pdf * lightPmf,
+                bsdf.pdf(hit.wo, wiLocal));
+        }
+
+        auto& lightRay = shadowRays[rayCount];
+        lightRay = Ray(hit.position + wi * EPS, wi);
+        lightRay.maxT = length(hit.position - sampledPosition) - eps;
+        contributions[rayCount] = f * lightEmission
+            * (abs(dot(hit.nl, wi)) * weight / (pdf * lightPmf));
+        ++rayCount;
+    }
+
+    *rays += rayCount;
+    scene.intersectShadow(shadowRays, rayCount, occluded);
+
+    Spectrum sum(0.0f);
+    for (int32_t i = 0; i < rayCount; ++i) {
+        if (!occluded[i])
+            sum += contributions[i];
+    }
+    return sum / (float)count;
+}
+
+// Draws the sampler dimensions sampleLights would take for count samples,
+// for bounces that skip light sampling
+template <typename TSampler>
+FINLINE void skipLightSamples(TSampler& sampler, int32_t count)
+{
+    count = std::min(std::max(count, 1), maxLightSamples);
+    for (int32_t i = 0; i < count; ++i) {
+        sampler.get1D();
+        sampler.get2D();
+    }
+}
+
+/*
+ * Unidirectional path tracer with russian roulette. Direct lighting combines
+ * light and BSDF sampling with multiple importance sampling.
+ *
+ * With a radiance cache, the radiance reflected by every Lambertian vertex
+ * of a path is added to the cache once the path is done, and paths that
+ * reach a Lambertian surface after a diffuse bounce take the reflected
+ * radiance from the cache instead of continuing, when the cache has it.
+ *
+ * With a caustic photon map, Lambertian surfaces add the caustics from the
+ * map, and emission found through a specular chain starting at a Lambertian
+ * surface is skipped, the map already accounts for it.
+ *
+ * With a guiding tree, bounces off Lambertian surfaces mix directions drawn
+ * from the learned incident light with BSDF samples, and while the tree
+ * trains, the light every path finds along its bounces is recorded into it.
+ */
+class PathTracer {
+public:
+    PathTracer(const IntegratorSettings& settings,
+        RadianceCache* cache = nullptr,
+        const CausticPhotonMap* causticMap = nullptr,
+        GuidingTree* guide = nullptr)
+        : maxDepth_(settings.maxDepth)
+        , mis_(settings.mis)
+        , cache_(cache)
+        , lightSamples_(std::min(std::max(settings.lightSamples, 1),
+            maxLightSamples))
+        , causticMap_(causticMap)
+        , guide_(guide)
+        , guideFraction_(std::min(std::max(settings.guidingFraction, 0.0f),
+            0.99f))
+    { }
+
+    template <typename TSampler>
+    FINLINE Spectrum li(const Scene& scene, const Ray& ray, TSampler& sampler,
+        PixelFeatures* features, uint64_t* rays) const
+    {
+        using std::abs;
+
+        Spectrum color { 0.0f };
+        Spectrum pathWeight { 1.0f };
+        Ray currentRay = ray;
+        RayHitInfo isect;
+
+        // Light hits of camera rays and delta bounces can't be light sampled,
+        // they get the full emission
+        bool specularBounce = true;
+        float bsdfPdf = 0.0f;
+        Vector3f previousPosition;
+        Vector3f previousNormal;
+        bool featuresDone = false;
+        // The last non specular vertex was Lambertian, so light reached
+        // through specular bounces since then is a caustic
+        bool causticChain = false;
+        CacheVertex cacheVertices[maxCacheVertices];
+        int32_t cacheVertexCount = 0;
+        GuideVertex guideVertices[maxGuideVertices];
+        int32_t guideVertexCount = 0;
+
+        for (auto bounce = 0; bounce < maxDepth_; ++bounce) {
+            ++*rays;
+            if (!scene.intersect(currentRay, &isect))
+                break;
+
+            if (!featuresDone)
+                featuresDone = recordFeatures(isect, features);
+
+            if (isect.areaLight && dot(isect.normal, currentRay.dir) < 0.0f) {
+                auto emission = pathWeight * isect.areaLight->intensity();
+                if (specularBounce) {
+                    if (!causticChain)
+                        color += emission;
+                } else if (mis_) {
+                    float lightPdf = scene.lightPmf(previousPosition,
+                        previousNormal, isect.areaLight)
+                        * isect.areaLight->pdf(previousPosition, currentRay.dir);
+                    color += emission * powerHeuristic(bsdfPdf,
+                        lightSamples_ * lightPdf);
+                }
+            }
+
+            if (!isect.bsdf)
+                break;
+
+            /*
+             * variables used below:
+             * wi - incident direction
+             * wo - outgoing direction
+             */
+            SurfaceHit hit(currentRay, isect);
+
+            if (cache_ && isect.bsdf->type() == BsdfType::Lambertian) {
+                auto albedo = isect.bsdf->albedo();
+                Spectrum irradiance;
+                if (bounce > 0 && !specularBounce
+                    && cache_->lookup(hit.position, hit.nl, &irradiance)) {
+                    color += pathWeight * albedo * irradiance;
+                    break;
+                }
+
+                if (cacheVertexCount < maxCacheVertices) {
+                    cacheVertices[cacheVertexCount++] = { hit.position, hit.nl,
+                        albedo, color, pathWeight };
+                }
+            }
+
+            if (causticMap_) {
+                if (isect.bsdf->type() == BsdfType::Lambertian) {
+                    color += pathWeight * isect.bsdf->albedo()
+                        * causticMap_->irradiance(hit.position, hit.nl)
+                        * INV_PI;
+                }
+                if (!isect.bsdf->isDelta())
+                    causticChain = isect.bsdf->type() == BsdfType::Lambertian;
+            }
+
+            // BSDF sampling alone handles delta surfaces. Their light sample
+            // dimensions are skipped, so that every bounce uses the same
+            // dimensions of the sampler.
+            if (!isect.bsdf->isDelta()) {
+                color += pathWeight * sampleLights(scene, *isect.bsdf, hit,
+                    sampler, rays, mis_, lightSamples_);
+            } else {
+                skipLightSamples(sampler, lightSamples_);
+            }
+
+            /*
+             * continue tracing
+             */
+            // Paths with a weight above one always continue, dividing by
+            // more than one would lose energy
+            float continueProbability = std::min(1.0f, pathWeight.y());
+            if (sampler.get1D() > continueProbability)
+                break;
+
+            pathWeight /= continueProbability;
+            Vector3f wi;
+            float pdf;
+            auto u = sampler.get2D();
+            bool guided = guide_ && isect.bsdf->type() == BsdfType::Lambertian;
+            uint32_t guideCell = 0;
+            const DirectionalTree* guideTree = nullptr;
+            if (guided) {
+                guideCell = guide_->cell(hit.position);
+                guideTree = guide_->samplingTree(guideCell);
+            }
+
+            // MIS against light sampling keeps using the BSDF density, the
+            // weights of the two strategies still sum to one
+            float pdfForMis;
+            Spectrum refl;
+            if (guideTree) {
+                refl = sampleGuided(*isect.bsdf, *guideTree, hit, u, &wi, &pdf,
+                    &pdfForMis);
+            } else {
+                refl = isect.bsdf->sample(hit.wo, &wi, u.x, u.y, &pdf);
+                pdfForMis = pdf;
+            }
+
+            if (refl.y() == 0.0f || pdf == 0.0f)
+                break;
+
+            specularBounce = isect.bsdf->isDelta();
+            bsdfPdf = pdfForMis;
+            previousPosition = hit.position;
+            previousNormal = hit.nl;
+
+            Vector3f dir = hit.frame.toWorld(wi);
+
+            pathWeight = pathWeight * refl * abs(dot(dir, hit.nl)) / pdf;
+            currentRay = { hit.position + dir * EPS, dir };
+
+            if (guided && guide_->training()
+                && guideVertexCount < maxGuideVertices) {
+                guideVertices[guideVertexCount++] = { guideCell, dir, color,
+                    pathWeight, pdf };
+            }
+        }
+
+        // Light gathered after leaving a vertex, over the path weight past
+        // the bounce, is the radiance arriving from the direction taken
+        for (int32_t i = 0; i < guideVertexCount; ++i) {
+            const auto& vertex = guideVertices[i];
+            guide_->record(vertex.cell, vertex.direction, color - vertex.color,
+                vertex.pathWeight, vertex.pdf);
+        }
+
+        // Everything the path gathered after a vertex, divided by the path
+        // weight at the vertex, is the radiance reflected there
+        for (int32_t i = 0; i < cacheVertexCount; ++i) {
+            const auto& vertex = cacheVertices[i];
+            cache_->add(vertex.position, vertex.normal, color - vertex.color,
+                vertex.pathWeight * vertex.albedo);
+        }
+
+        return color;
+    }
+
+private:
+    // Lambertian path vertex waiting to be added to the radiance cache
+    struct CacheVertex {
+        Vector3f position;
+        Vector3f normal;
+        Spectrum albedo;
+        // Color and weight of the path on arrival
+        Spectrum color;
+        Spectrum pathWeight;
+    };
+
+    static constexpr int32_t maxCacheVertices = 16;
+
+    // Bounce off a Lambertian surface waiting to be recorded into the
+    // guiding tree
+    struct GuideVertex {
+        uint32_t cell;
+        Vector3f direction;
+        // Color of the path when leaving and its weight after the bounce
+        Spectrum color;
+        Spectrum pathWeight;
+        float pdf;
+    };
+
+    static constexpr int32_t maxGuideVertices = 16;
+
+    // One sample MIS of the guiding distribution and the BSDF, u.x picks
+    // the strategy and is reused. Writes the mixture density to pdf and the
+    // BSDF density to bsdfPdf.
+    FINLINE Spectrum sampleGuided(const Bsdf& bsdf, const DirectionalTree& guide,
+        const SurfaceHit& hit, const Vector2f& u, Vector3f* wi, float* pdf,
+        float* bsdfPdf) const
+    {
+        Vector3f dir;
+        if (u.x < guideFraction_) {
+            dir = guide.sample(u.x / guideFraction_, u.y);
+            *wi = hit.frame.toLocal(dir);
+        } else {
+            float unused;
+            bsdf.sample(hit.wo, wi, (u.x - guideFraction_)
+                / (1.0f - guideFraction_), u.y, &unused);
+            dir = hit.frame.toWorld(*wi);
+        }
+
+        *bsdfPdf = bsdf.pdf(hit.wo, *wi);
+        *pdf = guideFraction_ * guide.pdf(dir)
+            + (1.0f - guideFraction_) * *bsdfPdf;
+        return bsdf.f(hit.wo, *wi);
+    }
+
+    int32_t maxDepth_;
+    bool mis_;
+    RadianceCache* cache_;
+    int32_t lightSamples_;
+    const CausticPhotonMap* causticMap_;
+    GuidingTree* guide_;
+    float guideFraction_;
+};
+
+/*
+ * Emission and light samples at the first non specular hit. Chains of
+ * specular surfaces in front of it are followed.
+ */
+class DirectLighting {
+public:
+    DirectLighting(const IntegratorSettings& settings)
+        : maxDepth_(settings.maxDepth)
+        , lightSamples_(std::min(std::max(settings.lightSamples, 1),
+            maxLightSamples))
+    { }
+
+    template <typename TSampler>
+    FINLINE Spectrum li(const Scene& scene, const Ray& ray, TSampler& sampler,
+        PixelFeatures* features, uint64_t* rays) const
+    {
+        using std::abs;
+
+        Spectrum color { 0.0f };
+        Spectrum pathWeight { 1.0f };
+        Ray currentRay = ray;
+        RayHitInfo isect;
+
+        for (auto bounce = 0; bounce < maxDepth_; ++bounce) {
+            ++*rays;
+            if (!scene.intersect(currentRay, &isect))
+                break;
+
+            recordFeatures(isect, features);
+
+            if (isect.areaLight && dot(isect.normal, currentRay.dir) < 0.0f)
+                color += pathWeight * isect.areaLight->intensity();
+
+            if (!isect.bsdf)
+                break;
+
+            SurfaceHit hit(currentRay, isect);
+
+            if (!isect.bsdf->isDelta()) {
+                color += pathWeight * sampleLights(scene, *isect.bsdf, hit,
+                    sampler, rays, false, lightSamples_);
+                break;
+            }
+
+            Vector3f wi;
+            float pdf;
+            auto u = sampler.get2D();
+            Spectrum refl = isect.bsdf->sample(hit.wo, &wi, u.x, u.y, &pdf);
+            if (refl.y() == 0.0f)
+                break;
+
+            Vector3f dir = hit.frame.toWorld(wi);
+            pathWeight = pathWeight * refl * abs(dot(dir, hit.nl)) / pdf;
+            currentRay = { hit.position + dir * EPS, dir };
+        }
+
+        return color;
+    }
+
+private:
+    int32_t maxDepth_;
+    int32_t lightSamples_;
+};
+
+/*
+ * Fraction of the cosine weighted hemisphere above the first hit that is not
+ * occluded within a distance
+ */
+class AmbientOcclusion {
+public:
+    AmbientOcclusion(const IntegratorSettings& settings, const Scene& scene)
+        : distance_(settings.aoDistance)
+    {
+        if (distance_ <= 0.0f) {
+            const auto& bounds = scene.getBounds();
+            distance_ = 0.1f * length(bounds.max - bounds.min);
+        }
+    }
+
+    template <typename TSampler>
+    FINLINE Spectrum li(const Scene& scene, const Ray& ray, TSampler& sampler,
+        PixelFeatures* features, uint64_t* rays) const
+    {
+        RayHitInfo isect;
+        ++*rays;
+        if (!scene.intersect(ray, &isect))
+            return Spectrum(0.0f);
+
+        recordFeatures(isect, features);
+
+        SurfaceHit hit(ray, isect);
+        auto u = sampler.get2D();
+        auto dir = hit.frame.toWorld(cosHemisphereSample(u.x, u.y));
+
+        auto aoRay = Ray(hit.position + dir * EPS, dir);
+        aoRay.maxT = distance_;
+
+        ++*rays;
+        return Spectrum(scene.intersectShadow(aoRay) ? 0.0f : 1.0f);
+    }
+
+private:
+    float distance_;
+};
+
+/*
+ * Preview shading of the first hit, lit by a light at the camera: albedo
+ * times the cosine between the surface and the camera ray, plus emission.
+ * Traces only the camera ray, so it runs at the speed of the BVH.
+ */
+class HeadlightIntegrator {
+public:
+    HeadlightIntegrator(const IntegratorSettings& settings)
+    {
+        UNUSED(settings);
+    }
+
+    template <typename TSampler>
+    FINLINE Spectrum li(const Scene& scene, const Ray& ray, TSampler& sampler,
+        PixelFeatures* features, uint64_t* rays) const
+    {
+        using std::abs;
+
+        UNUSED(sampler);
+
+        RayHitInfo isect;
+        ++*rays;
+        if (!scene.intersect(ray, &isect))
+            return Spectrum(0.0f);
+
+        recordFeatures(isect, features);
+
+        auto cosTheta = abs(dot(isect.shadingNormal, ray.dir));
+        auto color = features->albedo * cosTheta;
+        if (isect.areaLight && dot(isect.normal, ray.dir) < 0.0f)
+            color += isect.areaLight->intensity();
+        return color;
+    }
+};
+
+/*
+ * Debug view of the shading normals at the first hit
+ */
+class NormalsIntegrator {
+public:
+    NormalsIntegrator(const IntegratorSettings& settings)
+    {
+        UNUSED(settings);
+    }
+
+    template <typename TSampler>
+    FINLINE Spectrum li(const Scene& scene, const Ray& ray, TSampler& sampler,
+        PixelFeatures* features, uint64_t* rays) const
+    {
+        UNUSED(sampler);
+
+        RayHitInfo isect;
+        ++*rays;
+        if (!scene.intersect(ray, &isect))
+            return Spectrum(0.0f);
+
+        recordFeatures(isect, features);
+
+        const auto& n = isect.shadingNormal;
+        return Spectrum(
+            0.5f * (n.x + 1.0f),
+            0.5f * (n.y + 1.0f),
+            0.5f * (n.z + 1.0f));
+    }
+};
+
+#endif // INTEGRATOR_H
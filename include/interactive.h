@@ -0,0 +1,81 @@
+#if !defined(INTERACTIVE_H)
+#define INTERACTIVE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "renderer.h"
+#include "vector.h"
+
+class Camera;
+class Scene;
+
+/*
+ * Progressive rendering of a scene while the camera moves. A thread of its
+ * own renders passes of settings.samplesPerPass samples (1 for the fastest
+ * refresh) until the pixels have settings.samplesPerPixel, then waits for the
+ * camera to move. Moving the camera cancels the pass in flight, the workers
+ * finish the pixels they are on and start no more, and the next pass starts
+ * on an empty sensor from the new view. The scene and its acceleration
+ * structures are not touched.
+ *
+ * Learned integrator state (radiance cache, caustic photons, guiding) starts
+ * over with every view, as with any other render.
+ */
+class InteractiveSession {
+public:
+    // Called on the render thread after every completed pass, the camera
+    // sensor holds the image so far. view counts the camera moves the image
+    // reflects.
+    using FrameCallback = std::function<void(const RenderStats& stats,
+        const Camera& camera, uint64_t view)>;
+
+    // Called on the render thread once a view is done rendering, when it has
+    // its samples or the render stopped at a pass, time or error limit
+    using ViewCallback = std::function<void(uint64_t view)>;
+
+    // The camera is owned by the session thread while it runs
+    InteractiveSession(const Scene& scene, Camera& camera,
+        const RenderSettings& settings, TileOrder tileOrder);
+
+    // Stops rendering
+    ~InteractiveSession();
+
+    InteractiveSession(const InteractiveSession& copy) = delete;
+    InteractiveSession& operator=(const InteractiveSession& copy) = delete;
+
+    void start(FrameCallback callback, ViewCallback viewDone = nullptr);
+
+    void stop();
+
+    // Moves the camera, returns the view number frames of the new view get.
+    // direction has to be normalized.
+    uint64_t setView(const Vector3f& position, const Vector3f& direction);
+
+private:
+    void run();
+
+    const Scene& scene_;
+    Camera& camera_;
+    Renderer renderer_;
+    FrameCallback callback_;
+    ViewCallback viewDone_;
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    // Latest camera move, applied by the render thread
+    Vector3f position_;
+    Vector3f direction_;
+    uint64_t view_;
+    uint64_t appliedView_;
+    bool stopping_;
+    // Cancels the render of an outdated view
+    std::atomic<bool> cancel_;
+    std::thread thread_;
+};
+
+#endif // INTERACTIVE_H
@@ -4,11 +4,38 @@
 #include <memory>
 
 #include "constants.h"
+#include "frame.h"
+#include "platform.h"
 #include "shape.h"
 #include "spectrum.h"
 #include "vector.h"
 #include "qmc.h"
 
+// Spatial and directional extent of a light's emission, used to build the
+// light BVH. Emission leaves the bounds in directions within thetaO of axis w,
+// spread by up to thetaE from the surface normals.
+struct LightBounds {
+	BBox bounds;
+	Vector3f w;
+	// Total emitted power (luminance)
+	float phi = 0.0f;
+	float cosThetaO = 1.0f;
+	float cosThetaE = 1.0f;
+	bool twoSided = false;
+
+	LightBounds() { }
+
+	LightBounds(const BBox& bounds, const Vector3f& w, float phi,
+		float cosThetaO, float cosThetaE, bool twoSided)
+		: bounds(bounds)
+		, w(w)
+		, phi(phi)
+		, cosThetaO(cosThetaO)
+		, cosThetaE(cosThetaE)
+		, twoSided(twoSided)
+	{ }
+};
+
 class Light {
 public:
 	virtual ~Light() = 0;
@@ -19,11 +46,21 @@ public:
 		float u1, float u2
 	) const = 0;
 
+	// Solid angle pdf of sample() choosing direction wi from scenePosition,
+	// 0 for delta lights
+	virtual float pdf(const Vector3f& scenePosition, const Vector3f& wi) const = 0;
+
 	virtual Spectrum power() const = 0;
 
+	// Samples a ray leaving the light with density proportional to the
+	// emitted power, so that each of n such rays carries power() / n
+	virtual Ray samplePhoton(float u1, float u2, float u3, float u4) const = 0;
+
     virtual Spectrum intensity() const = 0;
 
 	virtual bool isDelta() const = 0;
+
+	virtual LightBounds lightBounds() const = 0;
 };
 
 inline Light::~Light()
@@ -52,11 +89,25 @@ public:
 		return intensity_ / length2(toLight); 
 	}
 
+	float pdf(const Vector3f& scenePosition, const Vector3f& wi) const override
+	{
+		UNUSED(scenePosition);
+		UNUSED(wi);
+		return 0.0f;
+	}
+
 	Spectrum power() const override
 	{
 		return intensity_ * 4.0f * PI;
 	}
 
+	Ray samplePhoton(float u1, float u2, float u3, float u4) const override
+	{
+		UNUSED(u3);
+		UNUSED(u4);
+		return Ray(position_, uniformSphereSample(u1, u2));
+	}
+
     Spectrum intensity() const override
     {
         return intensity_;
@@ -67,6 +118,13 @@ public:
 		return true;
 	}
 
+	// Emits in all directions
+	LightBounds lightBounds() const override
+	{
+		return LightBounds(BBox(position_), Vector3f(0.0f, 0.0f, 1.0f),
+			power().y(), -1.0f, 0.0f, false);
+	}
+
 private:
 	Vector3f position_;
 	Spectrum intensity_;
@@ -84,20 +142,38 @@ public:
 	Spectrum sample(const Vector3f& scenePosition, Vector3f* wi, float* pdf,
 		Vector3f* sampledPosition, float* eps, float u1, float u2) const override
 	{
-		Vector3f pos = emitter_->sample(u1, u2, pdf);
+		Vector3f lightNormal;
+		Vector3f pos = emitter_->sample(scenePosition, u1, u2, &lightNormal, pdf);
 		Vector3f toLight = pos - scenePosition;
 		*wi = normal(toLight);
 		*sampledPosition = pos;
 		*eps = 1e-3f;
-		return intensity_ / length2(toLight);
+		// Emits from the outside of the surface only
+		if (*pdf == 0.0f || dot(lightNormal, *wi) >= 0.0f)
+			return Spectrum(0.0f);
+		return intensity_;
+	}
+
+	float pdf(const Vector3f& scenePosition, const Vector3f& wi) const override
+	{
+		return emitter_->pdf(scenePosition, wi);
 	}
 
-	// Look into this
+	// Lambertian emitter of radiance intensity_
 	Spectrum power() const override
 	{
 		return intensity_ * area_ * PI;
 	}
 
+	// Uniform over the area and cosine weighted around the normal
+	Ray samplePhoton(float u1, float u2, float u3, float u4) const override
+	{
+		Vector3f lightNormal;
+		Vector3f pos = emitter_->sampleArea(u1, u2, &lightNormal);
+		Vector3f dir = Frame(lightNormal).toWorld(cosHemisphereSample(u3, u4));
+		return Ray(pos + lightNormal * 1e-3f, dir);
+	}
+
     Spectrum intensity() const override
     {
         return intensity_;
@@ -108,6 +184,14 @@ public:
 		return false;
 	}
 
+	// The emitter normals can face any direction, every point emits into its
+	// hemisphere
+	LightBounds lightBounds() const override
+	{
+		return LightBounds(emitter_->bounds(), Vector3f(0.0f, 0.0f, 1.0f),
+			power().y(), -1.0f, 0.0f, false);
+	}
+
 private:
 	std::shared_ptr<Shape> emitter_;
 	Spectrum intensity_;
@@ -0,0 +1,62 @@
+#if !defined(LIGHTBVH_H)
+#define LIGHTBVH_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "light.h"
+#include "vector.h"
+
+// Hierarchy over the scene lights for choosing lights that are likely to
+// contribute to a shading point. Every node keeps the bounds, emission cone
+// and power of the lights below it. Sampling walks from the root, choosing a
+// child with probability proportional to its estimated importance for the
+// shading point, so picking a light takes O(log n) regardless of the number
+// of lights.
+class LightBvh {
+public:
+    void build(const std::vector<std::shared_ptr<Light>>& lights);
+
+    // Returns the index of the picked light and writes the probability of
+    // picking it to pmf. Returns -1 if no light can contribute to the point.
+    // A zero normal disables culling by the surface orientation.
+    int32_t sample(const Vector3f& position, const Vector3f& normal, float u,
+        float* pmf) const;
+
+    // Probability of sample() picking the light at the point
+    float pmf(const Vector3f& position, const Vector3f& normal,
+        int32_t lightIdx) const;
+
+    size_t nodeCount() const
+    {
+        return nodes_.size();
+    }
+
+private:
+    struct Node {
+        LightBounds bounds;
+        // Second child of interior nodes (the first one directly follows the
+        // node), light index of leaves
+        int32_t index;
+        bool isLeaf;
+    };
+
+    struct BuildLight {
+        int32_t index;
+        LightBounds bounds;
+    };
+
+    // Builds nodes for lights [begin, end), bitTrail records the path from
+    // the root (1 for the second child) at depth bits
+    int32_t buildRecursive(std::vector<BuildLight>& lights, size_t begin,
+        size_t end, uint64_t bitTrail, int32_t depth);
+
+    std::vector<Node> nodes_;
+    // Path from the root to each light's leaf, lights without a leaf (no
+    // power) have no entry in the tree
+    std::vector<uint64_t> bitTrails_;
+    std::vector<uint8_t> inTree_;
+};
+
+#endif // LIGHTBVH_H
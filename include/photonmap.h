@@ -0,0 +1,90 @@
+#if !defined(PHOTONMAP_H)
+#define PHOTONMAP_H
+
+#include <cstdint>
+#include <vector>
+
+#include "bbox.h"
+#include "spectrum.h"
+#include "vector.h"
+
+class Scene;
+
+/*
+ * Caustic photons for the path tracer. Photons leave the lights, follow
+ * perfectly specular (delta) surfaces, and are stored where they land on a
+ * Lambertian surface after at least one specular bounce. That is the light
+ * transport the path tracer skips when it uses the map (light reaching a
+ * Lambertian surface through a specular chain), so every path is counted
+ * once.
+ *
+ * Workers trace photons into local buffers. Each buffer reserves its range of
+ * the shared photon array with a single atomic add, so storing takes no
+ * locks. The photons are then bucketed by a hashed grid of cells twice the
+ * lookup radius wide, so a lookup visits 8 cells.
+ *
+ * The map is rebuilt with fresh photons for every pass over the image, and the
+ * lookup radius shrinks between passes as in progressive photon mapping
+ * (Knaus and Zwicker, "Progressive Photon Mapping: A Probabilistic
+ * Approach"): r(i+1)^2 = r(i)^2 (i + alpha) / (i + 1). Averaging the passes
+ * converges to the correct caustics.
+ */
+class CausticPhotonMap {
+public:
+    // radius of 0 picks 1/500 of the scene diagonal
+    CausticPhotonMap(const Scene& scene, int32_t photonCount, float radius,
+        float alpha);
+
+    // Traces the photons of the next pass and shrinks the radius
+    void build(const Scene& scene);
+
+    // Irradiance at a point of a surface from the photons within the radius
+    // arriving at the side the normal faces. Multiply by albedo / pi for the
+    // radiance reflected by a Lambertian surface.
+    Spectrum irradiance(const Vector3f& position, const Vector3f& normal) const;
+
+    size_t storedPhotons() const
+    {
+        return photons_.size();
+    }
+
+    float radius() const
+    {
+        return radius_;
+    }
+
+private:
+    struct Photon {
+        Vector3f position;
+        // Direction the photon came from
+        Vector3f wi;
+        // Power carried, already divided by the number of emitted photons
+        Spectrum power;
+    };
+
+    // Integer grid coordinates of a point
+    void gridCell(const Vector3f& position, int32_t* cell) const;
+
+    size_t bucket(int32_t x, int32_t y, int32_t z) const;
+
+    int32_t photonCount_;
+    float alpha_;
+    // Radius of the current pass and the next one
+    float radius_;
+    float nextRadius_;
+    int32_t passes_;
+
+    // Bounds of the stored photons grown by the radius, most lookups are
+    // far from any caustic
+    BBox photonBounds_;
+
+    Vector3f gridOrigin_;
+    float invCellSize_;
+
+    std::vector<Photon> photons_;
+    // Photons of bucket b are [bucketStart_[b], bucketStart_[b + 1])
+    std::vector<uint32_t> bucketStart_;
+    size_t bucketMask_;
+};
+
+#endif // PHOTONMAP_H
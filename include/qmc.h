@@ -98,5 +98,24 @@ inline float uniformSpherePdf()
 	return 1.0f / (4.0f * PI);
 }
 
+// Uniformly distributed direction inside the cone around +z with the given
+// cosine of its half angle
+inline Vector3f uniformConeSample(float u1, float u2, float cosThetaMax)
+{
+	using std::sqrt;
+	using std::max;
+
+	float z = (1.0f - u1) + u1 * cosThetaMax;
+	float r = sqrt(max(0.0f, 1.0f - z * z));
+	float phi = 2.0f * PI * u2;
+
+	return Vector3f(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+inline float uniformConePdf(float cosThetaMax)
+{
+	return 1.0f / (2.0f * PI * (1.0f - cosThetaMax));
+}
+
 #endif // QMC_H
 
@@ -0,0 +1,81 @@
+#if !defined(RADIANCECACHE_H)
+#define RADIANCECACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "bbox.h"
+#include "spectrum.h"
+#include "vector.h"
+
+/*
+ * World space cache of the light reflected by diffuse surfaces. Space is
+ * divided into a uniform grid of cells, split further by the dominant axis of
+ * the surface normal, so the two sides of a thin wall don't share a cell.
+ * Each cell averages the reflected radiance divided by the albedo (the
+ * irradiance over pi) of the path vertices that landed in it. The cells live
+ * in a fixed size open addressing hash table, so memory is bounded, and are
+ * added and updated with atomics. Paths of all workers train the cache
+ * concurrently without locks.
+ *
+ * A lookup succeeds only once the cell has minSamples records. Larger cells
+ * and fewer samples give an answer sooner, with more bias.
+ */
+class RadianceCache {
+public:
+    // cellSize of 0 picks 1/128 of the scene diagonal. The table gets as
+    // many cells as fit into maxBytes.
+    RadianceCache(const BBox& bounds, float cellSize, uint32_t minSamples,
+        size_t maxBytes);
+
+    // Records a path vertex at a Lambertian surface. gathered is what the
+    // path collected after the vertex, weight the path weight at the vertex
+    // times the albedo, their ratio is the irradiance over pi. Dropped when
+    // the table is full.
+    void add(const Vector3f& position, const Vector3f& normal,
+        const Spectrum& gathered, const Spectrum& weight);
+
+    // Writes the average irradiance over pi recorded in the cell of the
+    // point, multiply it by the albedo for the reflected radiance. Returns
+    // false if the cell doesn't have enough records yet.
+    bool lookup(const Vector3f& position, const Vector3f& normal,
+        Spectrum* irradiance) const;
+
+    // Number of cells holding records
+    size_t cellCount() const
+    {
+        return usedCells_.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+private:
+    struct Cell {
+        // Zero for an empty cell
+        std::atomic<uint64_t> key;
+        std::atomic<float> sum[3];
+        std::atomic<uint32_t> count;
+    };
+
+    // Cells probed before giving up on a key
+    static constexpr uint32_t maxProbes = 16;
+
+    uint64_t cellKey(const Vector3f& position, const Vector3f& normal) const;
+
+    // Returns the cell of the key, claiming an empty one if insert is set.
+    // nullptr when the key isn't present (or the table is full).
+    Cell* findCell(uint64_t key, bool insert) const;
+
+    Vector3f origin_;
+    float invCellSize_;
+    uint32_t minSamples_;
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    mutable std::atomic<size_t> usedCells_;
+};
+
+#endif // RADIANCECACHE_H
@@ -1,18 +1,206 @@
 #if !defined(RENDERER_H)
 #define RENDERER_H
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "integrator.h"
+#include "sampler.h"
+#include "tile.h"
 
 class Scene;
 class Camera;
+class Sensor;
+struct PassInfo;
+
+struct RenderSettings {
+    // Total number of samples per pixel
+    int32_t samplesPerPixel = 4096;
+    // Samples each pixel gets in a single pass over the image. Equal to
+    // samplesPerPixel renders everything in one pass.
+    int32_t samplesPerPass = 4096;
+    // Stop after this many passes, 0 for no limit
+    int32_t maxPasses = 0;
+    // Stop once the average relative error of the image drops below this
+    // value, 0 to disable
+    float targetError = 0.0f;
+    // Adaptive sampling: a pixel stops taking samples once the relative error
+    // of its mean drops below this value, 0 to disable. Samples saved on
+    // converged pixels go to the noisy ones, up to maxSamples per pixel.
+    float adaptiveError = 0.0f;
+    // Samples every pixel gets before its error estimate is trusted
+    int32_t minSamples = 16;
+    // Adaptive sampling limit per pixel, 0 for 4 * samplesPerPixel
+    int32_t maxSamples = 0;
+    // Wall clock budget of the render in seconds, 0 for none. Passes are
+    // sized to spread samples evenly over the image until the deadline, no
+    // pixel is started after it. samplesPerPixel still limits the total.
+    double timeBudget = 0.0;
+    // Light transport algorithm and its parameters
+    IntegratorSettings integrator;
+    // Source of the random numbers of the integrator
+    SamplerType sampler = SamplerType::Sobol;
+};
+
+struct RenderStats {
+    // Wall clock time of the whole frame
+    double seconds = 0.0;
+    // Number of rays traced (camera, bounce and shadow rays)
+    uint64_t rays = 0;
+    double raysPerSecond = 0.0;
+    // Time between the last tile being picked up by a worker and the end of
+    // the pass, summed over passes. Workers run out of work during that time.
+    double tailSeconds = 0.0;
+    // Slowest single tile of any pass
+    double maxTileSeconds = 0.0;
+    // Time workers spent without work before the frame finished
+    double idleSeconds = 0.0;
+    // Number of tile pieces split off running tiles by idle workers
+    uint64_t splits = 0;
+    // Number of passes over the image
+    int32_t passes = 0;
+    // Samples taken and the average per pixel
+    uint64_t samples = 0;
+    float samplesPerPixel = 0.0f;
+    // Pixels still taking samples in the last pass
+    int64_t activePixels = 0;
+    // Lowest number of samples of any pixel on the sensor
+    uint32_t minSamplesPerPixel = 0;
+    // Time the render took past its time budget, negative if it finished
+    // early. Only set when rendering with a time budget.
+    double overshootSeconds = 0.0;
+    // Average relative error of the image after the last pass
+    float error = 0.0f;
+    // Radiance cache cells holding records and the size of the cache, zero
+    // without a cache
+    uint64_t cacheCells = 0;
+    uint64_t cacheCapacity = 0;
+    // Caustic photons stored in the last pass and their lookup radius, zero
+    // without caustic photons
+    uint64_t causticPhotons = 0;
+    float causticRadius = 0.0f;
+    // Cells of the path guiding tree and training iterations done, zero
+    // without guiding
+    uint64_t guidingCells = 0;
+    int32_t guidingIterations = 0;
+};
 
 class Renderer {
 public:
-    void render(const Scene& scene, Camera& camera) const;
+    // Adds samples to the camera sensor until every pixel has
+    // samplesPerPixel of them (or the adaptive/stopping criteria are met).
+    // Samples already on the sensor count, so rendering can be continued.
+    void render(const Scene& scene, Camera& camera);
+
+    // Takes samples [sampleBegin, sampleEnd) of every pixel in region in a
+    // single pass and adds them to the camera sensor, which should hold no
+    // samples of the region. The samples are the ones a render that already
+    // has sampleBegin of them would take next. Distributed workers render
+    // their jobs with it.
+    void renderRegion(const Scene& scene, Camera& camera, const Tile& region,
+        int32_t sampleBegin, int32_t sampleEnd);
+
+    // Called after every pass with the statistics so far, the image on the
+    // camera sensor is complete for the pass. Returning false stops rendering.
+    using PassCallback = std::function<bool(const RenderStats&, Camera&)>;
+
+    void setSettings(const RenderSettings& settings)
+    {
+        settings_ = settings;
+    }
+
+    const RenderSettings& getSettings() const
+    {
+        return settings_;
+    }
+
+    void setPassCallback(PassCallback callback)
+    {
+        passCallback_ = callback;
+    }
+
+    // Once the flag is set, workers start no more pixels and render returns
+    // after the pixels in flight, without calling the pass callback for the
+    // cut short pass. The flag is only read, clearing it is up to the owner.
+    void setCancelFlag(const std::atomic<bool>* cancel)
+    {
+        cancel_ = cancel;
+    }
+
+    void setTileOrder(TileOrder order)
+    {
+        tileOrder_ = order;
+    }
+
+    TileOrder getTileOrder() const
+    {
+        return tileOrder_;
+    }
+
+    const RenderStats& getStats() const
+    {
+        return stats_;
+    }
 
 private:
+    // Flag the pixels that still need samples, returns their number
+    int64_t updateActivePixels(const Sensor& sensor, const PassInfo& pass,
+        std::vector<uint8_t>* active) const;
+
+    // Picks the sampler for render
+    template <typename TIntegrator>
+    void renderWithSampler(const Scene& scene, Camera& camera,
+        const TIntegrator& integrator);
+
+    // Pass loop of render, specialized on the integrator and sampler
+    template <typename TIntegrator, typename TSampler>
+    void renderPasses(const Scene& scene, Camera& camera,
+        const TIntegrator& integrator, const TSampler& sampler);
+
+    // Add samples to the active pixels, adds the pass measurements to stats_
+    template <typename TIntegrator, typename TSampler>
+    void renderPass(const TIntegrator& integrator, const TSampler& sampler,
+        const Scene& scene, Camera& camera, const PassInfo& pass);
+
+    // Renders the region of renderRegion in place of the pass loop
+    template <typename TIntegrator, typename TSampler>
+    void renderRegionPass(const Scene& scene, Camera& camera,
+        const TIntegrator& integrator, const TSampler& sampler);
+
     static constexpr int32_t tileSize_ = 32;
+
+    struct Region {
+        Tile tile;
+        int32_t sampleBegin;
+        int32_t sampleEnd;
+    };
+
+    // Set while renderRegion runs
+    const Region* region_ = nullptr;
+
+    RenderSettings settings_;
+    PassCallback passCallback_;
+    const std::atomic<bool>* cancel_ = nullptr;
+
+    TileOrder tileOrder_ = TileOrder::Hilbert;
+
+    // Seconds spent on each tile in the previous pass, row major over the tile
+    // grid. Used by TileOrder::CostSorted
+    std::vector<float> tileCosts_;
+
+    // Radiance cache of the path tracer, trained by all passes of a render
+    std::unique_ptr<RadianceCache> radianceCache_;
+    // Caustic photons of the path tracer, traced again before every pass
+    std::unique_ptr<CausticPhotonMap> causticMap_;
+    // Path guiding distribution, trained by the first passes of a render
+    std::unique_ptr<GuidingTree> guidingTree_;
+
+    RenderStats stats_;
 };
 
-#endif // RENDERER_H
+void printRenderStats(const RenderStats& stats);
 
+#endif // RENDERER_H
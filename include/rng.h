@@ -1,33 +1,254 @@
 #if !defined(RNG_H)
 #define RNG_H
 
-#include <random>
+#include <cstdint>
 
-class Rng {
+#include <immintrin.h>
+
+#include "platform.h"
+#include "utils.h"
+#include "vector8.h"
+
+// Float in [0, 1) from the upper 23 bits of v, placed in the mantissa of a
+// float in [1, 2)
+FINLINE float uintToUnitFloat(uint32_t v)
+{
+    return convertBits<uint32_t, float>((v >> 9) | 0x3f800000u) - 1.0f;
+}
+
+/*
+ * PCG32 (O'Neill, "PCG: A Family of Simple Fast Space-Efficient Statistically
+ * Good Algorithms for Random Number Generation"). 16 bytes of state, 2^63
+ * independent sequences of period 2^64, and jumps in O(log n).
+ */
+class Pcg32 {
+public:
+    Pcg32(uint64_t seed = 1234, uint64_t sequence = defaultSequence)
+    {
+        setSequence(sequence, seed);
+    }
+
+    void setSequence(uint64_t sequence, uint64_t seed)
+    {
+        state_ = 0;
+        inc_ = (sequence << 1) | 1;
+        randomUInt();
+        state_ += seed;
+        randomUInt();
+    }
+
+    // Continue the sequence as if delta numbers were drawn (delta may be
+    // negative, in two's complement)
+    void advance(uint64_t delta)
+    {
+        uint64_t curMult = multiplier;
+        uint64_t curPlus = inc_;
+        uint64_t accMult = 1;
+        uint64_t accPlus = 0;
+        while (delta > 0) {
+            if (delta & 1) {
+                accMult *= curMult;
+                accPlus = accPlus * curMult + curPlus;
+            }
+            curPlus = (curMult + 1) * curPlus;
+            curMult *= curMult;
+            delta >>= 1;
+        }
+        state_ = accMult * state_ + accPlus;
+    }
+
+    FINLINE uint32_t randomUInt()
+    {
+        uint64_t old = state_;
+        state_ = old * multiplier + inc_;
+        auto xorShifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+        auto rot = (uint32_t)(old >> 59);
+        return (xorShifted >> rot) | (xorShifted << ((~rot + 1) & 31));
+    }
+
+    FINLINE int32_t randomInt()
+    {
+        return (int32_t)(randomUInt() >> 1);
+    }
+
+    FINLINE float randomFloat()
+    {
+        return uintToUnitFloat(randomUInt());
+    }
+
+private:
+    static constexpr uint64_t multiplier = 0x5851f42d4c957f2dull;
+    static constexpr uint64_t defaultSequence = 0xda3e39cb94b95bdbull;
+
+    uint64_t state_;
+    uint64_t inc_;
+};
+
+/*
+ * xoshiro128+ (Blackman, Vigna), 16 bytes of state and period 2^128 - 1.
+ * jump() skips 2^64 numbers, for up to 2^64 non overlapping streams.
+ */
+class Xoshiro128Plus {
 public:
-	Rng(int32_t seed = 1234) : rng_(seed)
-	{ }
+    Xoshiro128Plus(uint64_t seed = 1234)
+    {
+        // Expand the seed with splitmix64, which never yields all zero state
+        for (int i = 0; i < 4; i += 2) {
+            seed += 0x9e3779b97f4a7c15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            z ^= z >> 31;
+            s_[i] = (uint32_t)z;
+            s_[i + 1] = (uint32_t)(z >> 32);
+        }
+    }
+
+    void jump()
+    {
+        static const uint32_t jumpTable[] = {
+            0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b
+        };
+
+        uint32_t s[4] = { 0, 0, 0, 0 };
+        for (auto jump : jumpTable) {
+            for (int b = 0; b < 32; ++b) {
+                if (jump & (1u << b)) {
+                    for (int i = 0; i < 4; ++i) {
+                        s[i] ^= s_[i];
+                    }
+                }
+                randomUInt();
+            }
+        }
+        for (int i = 0; i < 4; ++i) {
+            s_[i] = s[i];
+        }
+    }
+
+    FINLINE uint32_t randomUInt()
+    {
+        uint32_t result = s_[0] + s_[3];
+        uint32_t t = s_[1] << 9;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = (s_[3] << 11) | (s_[3] >> 21);
+        return result;
+    }
 
-	int32_t randomInt()
-	{
-		return distInt_(rng_);
-	}
+    FINLINE int32_t randomInt()
+    {
+        return (int32_t)(randomUInt() >> 1);
+    }
 
-	uint32_t randomUInt()
-	{
-		return distUint_(rng_);
-	}
+    FINLINE float randomFloat()
+    {
+        return uintToUnitFloat(randomUInt());
+    }
 
-	float randomFloat()
-	{
-		return distFloat_(rng_);
-	}
+    const uint32_t* state() const
+    {
+        return s_;
+    }
 
 private:
-	std::mt19937_64 rng_;
-	std::uniform_int_distribution<int32_t> distInt_;
-	std::uniform_int_distribution<uint32_t> distUint_;
-	std::uniform_real_distribution<float> distFloat_;
+    uint32_t s_[4];
 };
 
+/*
+ * Eight xoshiro128+ generators in the lanes of AVX registers, producing eight
+ * floats per call. Lane i continues the sequence of the seed generator jumped
+ * i times, so lanes never overlap. Without AVX2 integer instructions the
+ * state is updated in two SSE halves.
+ */
+class Xoshiro128Plus8 {
+public:
+    Xoshiro128Plus8(uint64_t seed = 1234)
+    {
+        Xoshiro128Plus lane(seed);
+        alignas(32) uint32_t s[4][8];
+        for (int i = 0; i < 8; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                s[j][i] = lane.state()[j];
+            }
+            lane.jump();
+        }
+        for (int j = 0; j < 4; ++j) {
+            s_[j] = _mm256_load_si256((const __m256i*)s[j]);
+        }
+    }
+
+    FINLINE IntVector8 randomUInt()
+    {
+#if defined(YART_AVX2)
+        auto result = _mm256_add_epi32(s_[0], s_[3]);
+        auto t = _mm256_slli_epi32(s_[1], 9);
+        s_[2] = _mm256_xor_si256(s_[2], s_[0]);
+        s_[3] = _mm256_xor_si256(s_[3], s_[1]);
+        s_[1] = _mm256_xor_si256(s_[1], s_[2]);
+        s_[0] = _mm256_xor_si256(s_[0], s_[3]);
+        s_[2] = _mm256_xor_si256(s_[2], t);
+        s_[3] = _mm256_or_si256(_mm256_slli_epi32(s_[3], 11),
+            _mm256_srli_epi32(s_[3], 21));
+        return IntVector8(result);
+#else
+        __m128i lo[4];
+        __m128i hi[4];
+        for (int j = 0; j < 4; ++j) {
+            lo[j] = _mm256_castsi256_si128(s_[j]);
+            hi[j] = _mm256_extractf128_si256(s_[j], 1);
+        }
+        auto resultLo = step(lo);
+        auto resultHi = step(hi);
+        for (int j = 0; j < 4; ++j) {
+            s_[j] = _mm256_insertf128_si256(_mm256_castsi128_si256(lo[j]), hi[j], 1);
+        }
+        return IntVector8(_mm256_insertf128_si256(
+            _mm256_castsi128_si256(resultLo), resultHi, 1));
+#endif
+    }
+
+    FINLINE Vector8 randomFloat()
+    {
+        // Same mantissa trick as uintToUnitFloat, the shift and or are done
+        // on the SSE halves when AVX2 is missing
+        auto bits = randomUInt().ymm;
+#if defined(YART_AVX2)
+        auto mantissa = _mm256_or_si256(_mm256_srli_epi32(bits, 9),
+            _mm256_set1_epi32(0x3f800000));
+#else
+        auto one = _mm_set1_epi32(0x3f800000);
+        auto lo = _mm_or_si128(_mm_srli_epi32(_mm256_castsi256_si128(bits), 9), one);
+        auto hi = _mm_or_si128(_mm_srli_epi32(_mm256_extractf128_si256(bits, 1), 9), one);
+        auto mantissa = _mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1);
+#endif
+        return Vector8(_mm256_sub_ps(_mm256_castsi256_ps(mantissa),
+            _mm256_set1_ps(1.0f)));
+    }
+
+private:
+#if !defined(YART_AVX2)
+    FINLINE static __m128i step(__m128i* s)
+    {
+        auto result = _mm_add_epi32(s[0], s[3]);
+        auto t = _mm_slli_epi32(s[1], 9);
+        s[2] = _mm_xor_si128(s[2], s[0]);
+        s[3] = _mm_xor_si128(s[3], s[1]);
+        s[1] = _mm_xor_si128(s[1], s[2]);
+        s[0] = _mm_xor_si128(s[0], s[3]);
+        s[2] = _mm_xor_si128(s[2], t);
+        s[3] = _mm_or_si128(_mm_slli_epi32(s[3], 11), _mm_srli_epi32(s[3], 21));
+        return result;
+    }
+#endif
+
+    __m256i s_[4];
+};
+
+// Default generator of the renderer
+using Rng = Pcg32;
+
 #endif // RNG_H
@@ -0,0 +1,358 @@
+#if !defined(SAMPLER_H)
+#define SAMPLER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "platform.h"
+#include "rng.h"
+#include "vector.h"
+
+// Samplers generate the random numbers an integrator consumes, indexed by
+// pixel, sample index within the pixel and dimension (the position of a draw
+// within the sample). Like integrators, samplers don't share a virtual
+// interface, tile tasks are templated on the sampler type. Every sampler
+// provides:
+//
+//     Sampler(const Vector2i& resolution, int32_t samplesPerPixel);
+//     void startPixelSample(int32_t x, int32_t y, int32_t sampleIndex);
+//     float get1D();
+//     Vector2f get2D();
+//
+// get1D uses one dimension, get2D two. As long as the integrator draws in the
+// same order, a sample of a pixel gets the same numbers no matter in which
+// pass or on which worker it is taken.
+
+enum class SamplerType : int32_t {
+    // Uncorrelated random numbers
+    Independent,
+    // Jittered strata over samplesPerPixel, per dimension
+    Stratified,
+    // Halton sequence with a random shift per pixel
+    Halton,
+    // Owen scrambled Sobol points, padded in pairs of dimensions
+    Sobol,
+};
+
+const char* samplerName(SamplerType type);
+
+bool parseSampler(const char* name, SamplerType* type);
+
+// Hashing used to decorrelate pixels and dimensions
+FINLINE uint64_t mixBits(uint64_t v)
+{
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ull;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dull;
+    v ^= v >> 33;
+    return v;
+}
+
+FINLINE uint64_t hashCombine(uint64_t seed, uint64_t v)
+{
+    return mixBits(seed ^ (v + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)));
+}
+
+// Float in [0, 1) from the high bits of v
+FINLINE float toUnitFloat(uint32_t v)
+{
+    return std::min((float)(v >> 8) * 0x1p-24f, 0x1.fffffep-1f);
+}
+
+FINLINE uint32_t reverseBits(uint32_t v)
+{
+    v = (v << 16) | (v >> 16);
+    v = ((v & 0x00ff00ff) << 8) | ((v & 0xff00ff00) >> 8);
+    v = ((v & 0x0f0f0f0f) << 4) | ((v & 0xf0f0f0f0) >> 4);
+    v = ((v & 0x33333333) << 2) | ((v & 0xcccccccc) >> 2);
+    v = ((v & 0x55555555) << 1) | ((v & 0xaaaaaaaa) >> 1);
+    return v;
+}
+
+// Owen scrambling of a 32 bit fixed point number in base 2, following
+// Burley, "Practical Hash-based Owen Scrambling"
+FINLINE uint32_t laineKarrasPermutation(uint32_t v, uint32_t seed)
+{
+    v += seed;
+    v ^= v * 0x6c50b47cu;
+    v ^= v * 0xb82f1e52u;
+    v ^= v * 0xc7afe638u;
+    v ^= v * 0x8d22f6e6u;
+    return v;
+}
+
+FINLINE uint32_t nestedUniformScramble(uint32_t v, uint32_t seed)
+{
+    return reverseBits(laineKarrasPermutation(reverseBits(v), seed));
+}
+
+// Element i of a random permutation of [0, n), Kensler's "Correlated
+// Multi-Jittered Sampling"
+FINLINE uint32_t permutationElement(uint32_t i, uint32_t n, uint32_t seed)
+{
+    uint32_t w = n - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= seed;
+        i *= 0xe170893d;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3f;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return (i + seed) % n;
+}
+
+/*
+ * Independent uniform random numbers. Every pixel has its own PCG sequence,
+ * sample k of the pixel starts 2^16 numbers after sample k - 1.
+ */
+class IndependentSampler {
+public:
+    IndependentSampler(const Vector2i& resolution, int32_t samplesPerPixel)
+        : width_(resolution.x)
+    {
+        UNUSED(samplesPerPixel);
+    }
+
+    FINLINE void startPixelSample(int32_t x, int32_t y, int32_t sampleIndex)
+    {
+        rng_.setSequence(mixBits((uint64_t)y * width_ + x), 0x5eed);
+        rng_.advance((uint64_t)sampleIndex * samplesStride);
+    }
+
+    FINLINE float get1D()
+    {
+        return rng_.randomFloat();
+    }
+
+    FINLINE Vector2f get2D()
+    {
+        float u1 = rng_.randomFloat();
+        float u2 = rng_.randomFloat();
+        return Vector2f(u1, u2);
+    }
+
+private:
+    static constexpr uint64_t samplesStride = 1 << 16;
+
+    int32_t width_;
+    Rng rng_;
+};
+
+// Shared by the low discrepancy samplers, a hash seed per pixel and the
+// position within the sample
+class PixelSampleState {
+public:
+    FINLINE void startPixelSample(int32_t x, int32_t y, int32_t sampleIndex)
+    {
+        pixelSeed_ = hashCombine(mixBits(((uint64_t)(uint32_t)x << 32)
+            | (uint32_t)y), 0x5eed);
+        sampleIndex_ = (uint32_t)sampleIndex;
+        dimension_ = 0;
+    }
+
+protected:
+    // Random bits for the current dimension of the pixel
+    FINLINE uint64_t dimensionHash() const
+    {
+        return hashCombine(pixelSeed_, dimension_);
+    }
+
+    // Random bits unique to the current sample and dimension
+    FINLINE uint64_t sampleHash() const
+    {
+        return hashCombine(dimensionHash(), sampleIndex_);
+    }
+
+    uint64_t pixelSeed_ = 0;
+    uint32_t sampleIndex_ = 0;
+    uint32_t dimension_ = 0;
+};
+
+/*
+ * Jittered stratification of every dimension (and pair of dimensions) over
+ * samplesPerPixel strata. Each dimension visits the strata in a different
+ * random order, so that dimensions aren't correlated.
+ */
+class StratifiedSampler : public PixelSampleState {
+public:
+    StratifiedSampler(const Vector2i& resolution, int32_t samplesPerPixel)
+        : samples_((uint32_t)std::max(1, samplesPerPixel))
+    {
+        UNUSED(resolution);
+        strataX_ = std::max(1u, (uint32_t)std::sqrt((double)samples_));
+        strataY_ = (samples_ + strataX_ - 1) / strataX_;
+    }
+
+    FINLINE float get1D()
+    {
+        auto stratum = permutationElement(sampleIndex_ % samples_, samples_,
+            (uint32_t)dimensionHash());
+        float jitter = toUnitFloat((uint32_t)sampleHash());
+        dimension_ += 1;
+        return std::min((stratum + jitter) / samples_, 0x1.fffffep-1f);
+    }
+
+    FINLINE Vector2f get2D()
+    {
+        auto strata = strataX_ * strataY_;
+        auto stratum = permutationElement(sampleIndex_ % strata, strata,
+            (uint32_t)dimensionHash());
+        auto jitter = sampleHash();
+        float jitterX = toUnitFloat((uint32_t)jitter);
+        float jitterY = toUnitFloat((uint32_t)(jitter >> 32));
+        dimension_ += 2;
+        return Vector2f(
+            std::min(((stratum % strataX_) + jitterX) / strataX_, 0x1.fffffep-1f),
+            std::min(((stratum / strataX_) + jitterY) / strataY_, 0x1.fffffep-1f));
+    }
+
+private:
+    uint32_t samples_;
+    uint32_t strataX_;
+    uint32_t strataY_;
+};
+
+/*
+ * Halton sequence, dimension d uses the radical inverse in the d-th prime
+ * base. Every pixel shifts the sequence by a random offset per dimension
+ * (Cranley-Patterson rotation). Dimensions past the prime table get random
+ * numbers.
+ */
+class HaltonSampler : public PixelSampleState {
+public:
+    HaltonSampler(const Vector2i& resolution, int32_t samplesPerPixel)
+    {
+        UNUSED(resolution);
+        UNUSED(samplesPerPixel);
+    }
+
+    FINLINE float get1D()
+    {
+        float u = sample();
+        dimension_ += 1;
+        return u;
+    }
+
+    FINLINE Vector2f get2D()
+    {
+        float u1 = sample();
+        dimension_ += 1;
+        float u2 = sample();
+        dimension_ += 1;
+        return Vector2f(u1, u2);
+    }
+
+private:
+    static constexpr uint32_t primeCount = 64;
+
+    static uint32_t prime(uint32_t dimension)
+    {
+        static const uint32_t primes[primeCount] = {
+            2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+            59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131,
+            137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+            227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311,
+        };
+        return primes[dimension];
+    }
+
+    FINLINE float radicalInverse(uint32_t base, uint32_t index) const
+    {
+        float invBase = 1.0f / base;
+        float invBaseN = 1.0f;
+        uint32_t reversed = 0;
+        while (index) {
+            uint32_t next = index / base;
+            reversed = reversed * base + (index - next * base);
+            invBaseN *= invBase;
+            index = next;
+        }
+        return std::min(reversed * invBaseN, 0x1.fffffep-1f);
+    }
+
+    FINLINE float sample() const
+    {
+        if (dimension_ >= primeCount)
+            return toUnitFloat((uint32_t)sampleHash());
+
+        float u = radicalInverse(prime(dimension_), sampleIndex_)
+            + toUnitFloat((uint32_t)dimensionHash());
+        return u >= 1.0f ? u - 1.0f : u;
+    }
+};
+
+/*
+ * Owen scrambled Sobol points. Pairs of dimensions use the first two Sobol
+ * dimensions, with the sample index shuffled differently for every pair
+ * (padding), so that the quality doesn't degrade in high dimensions. The
+ * scrambling keeps every power of two prefix of the samples stratified, so
+ * progressive passes stay well distributed.
+ */
+class SobolSampler : public PixelSampleState {
+public:
+    SobolSampler(const Vector2i& resolution, int32_t samplesPerPixel)
+    {
+        UNUSED(resolution);
+        UNUSED(samplesPerPixel);
+    }
+
+    FINLINE float get1D()
+    {
+        auto seeds = dimensionHash();
+        auto index = nestedUniformScramble(sampleIndex_, (uint32_t)seeds);
+        auto v = nestedUniformScramble(reverseBits(index),
+            (uint32_t)(seeds >> 32));
+        dimension_ += 1;
+        return toUnitFloat(v);
+    }
+
+    FINLINE Vector2f get2D()
+    {
+        auto seeds = dimensionHash();
+        auto valueSeeds = mixBits(seeds);
+        auto index = nestedUniformScramble(sampleIndex_, (uint32_t)seeds);
+        auto v1 = nestedUniformScramble(reverseBits(index),
+            (uint32_t)(seeds >> 32));
+        auto v2 = nestedUniformScramble(sobolSecondDimension(index),
+            (uint32_t)valueSeeds);
+        dimension_ += 2;
+        return Vector2f(toUnitFloat(v1), toUnitFloat(v2));
+    }
+
+private:
+    // The generator matrix of the second Sobol dimension is the Pascal
+    // matrix mod 2, which can be applied to the bit reversed index in five
+    // steps instead of a loop over the direction numbers
+    FINLINE static uint32_t sobolSecondDimension(uint32_t index)
+    {
+        uint32_t v = reverseBits(index);
+        v ^= (v << 1) & 0xaaaaaaaa;
+        v ^= (v << 2) & 0xcccccccc;
+        v ^= (v << 4) & 0xf0f0f0f0;
+        v ^= (v << 8) & 0xff00ff00;
+        v ^= (v << 16) & 0xffff0000;
+        return v;
+    }
+};
+
+#endif // SAMPLER_H
@@ -1,19 +1,35 @@
 #if !defined(SCENE_H)
 #define SCENE_H
 
+#include <unordered_map>
 #include <vector>
 
+#include "distribution.h"
 #include "platform.h"
 #include "vector.h"
 
 #include "bvhaccel.h"
 #include "light.h"
+#include "lightbvh.h"
 #include "sphere.h"
 #include "triaccel.h"
 #include "triangle.h"
 
 class PointLight;
 
+// How shading points choose the light to sample
+enum class LightSampling : int32_t {
+    Uniform,
+    // Proportionally to Light::power()
+    Power,
+    // By estimated contribution to the shading point, using the light BVH
+    Bvh,
+};
+
+const char* lightSamplingName(LightSampling sampling);
+
+bool parseLightSampling(const char* name, LightSampling* sampling);
+
 class Scene {
 public:
 	Scene(
@@ -32,6 +48,7 @@ public:
 	~Scene()
 	{
         alignedFree(triaccel_);
+        alignedFree(triaccel8_);
 	}
 
 	void preprocess()
@@ -49,7 +66,7 @@ public:
         alignedFree(triaccel8_);
 
         triaccel_ = alignedAlloc<TriAccel>(triangleCount_, 16);
-        triaccel8_ = alignedAlloc<TriAccel8>(triaccel8Count_, 16);
+        triaccel8_ = alignedAlloc<TriAccel8>(triaccel8Count_, 32);
 
 		auto triaccelIdx = 0;
 		for (mesh_size_t meshIdx = 0; meshIdx < meshes_.size(); ++meshIdx) {
@@ -70,7 +87,17 @@ public:
 
         loadTriaccel8(triaccel8_, triaccel_, triangleCount_);
 
+        bounds_ = BBox();
+        for (const auto& mesh : meshes_) {
+            bounds_ = boxUnion(bounds_, mesh.getBounds());
+        }
+        for (const auto& shape : shapes_) {
+            bounds_ = boxUnion(bounds_, shape->bounds());
+        }
+
         accel_ = std::make_shared<BvhAccel>(*this);
+
+        buildLightDistribution();
 	}
 
     bool intersect8(const Ray& ray, RayHitInfo* const isect) const
@@ -193,6 +220,24 @@ public:
 		return false;
 	}
 
+    // Occlusion of a batch of rays, see BvhAccel::intersectShadow
+    void intersectShadow(const Ray* rays, int32_t count, bool* occluded) const
+    {
+        for (int32_t i = 0; i < count; ++i) {
+            RayHitInfo hitInfo;
+            hitInfo.t = rays[i].maxT;
+            occluded[i] = false;
+            for (const auto& shape : shapes_) {
+                if (shape->intersect(rays[i], &hitInfo)) {
+                    occluded[i] = true;
+                    break;
+                }
+            }
+        }
+
+        accel_->intersectShadow(rays, count, occluded);
+    }
+
     bool intersectBounds(const Ray& ray, RayHitInfo* const isect) const
     {
         isect->t = ray.maxT;
@@ -234,15 +279,82 @@ public:
 		return lights_;
 	}
 
+    // Picks a light to sample for a shading point with the given normal,
+    // writes the probability of picking it to pmf. Returns nullptr if there
+    // is no light to sample.
+    FINLINE const Light* sampleLight(const Vector3f& position,
+        const Vector3f& normal, float u, float* pmf) const
+    {
+        if (lights_.empty()) {
+            *pmf = 0.0f;
+            return nullptr;
+        }
+
+        if (lightSampling_ == LightSampling::Bvh) {
+            auto idx = lightBvh_.sample(position, normal, u, pmf);
+            return idx >= 0 ? lights_[idx].get() : nullptr;
+        }
+
+        return lights_[lightDistribution_.sample(u, pmf)].get();
+    }
+
+    // Probability of sampleLight picking the light
+    float lightPmf(const Vector3f& position, const Vector3f& normal,
+        const Light* light) const
+    {
+        auto it = lightIndices_.find(light);
+        if (it == lightIndices_.end())
+            return 0.0f;
+
+        if (lightSampling_ == LightSampling::Bvh)
+            return lightBvh_.pmf(position, normal, it->second);
+
+        return lightDistribution_.pmf(it->second);
+    }
+
+    // Takes effect on the next preprocess
+    void setLightSampling(LightSampling sampling)
+    {
+        lightSampling_ = sampling;
+    }
+
+    LightSampling getLightSampling() const
+    {
+        return lightSampling_;
+    }
+
     const std::vector<TriangleMesh>& getTriangleMeshes() const
     {
         return meshes_;
     }
 
+    // Bounds of all meshes and shapes, valid after preprocess
+    const BBox& getBounds() const
+    {
+        return bounds_;
+    }
+
+    // Estimate of the memory the meshes and acceleration structures take,
+    // valid after preprocess. Shapes, lights and materials are small next to
+    // them and left out.
+    size_t memoryBytes() const
+    {
+        size_t bytes = triangleCount_ * sizeof(TriAccel)
+            + triaccel8Count_ * sizeof(TriAccel8);
+        for (const auto& mesh : meshes_) {
+            bytes += mesh.memoryBytes();
+        }
+        if (accel_)
+            bytes += accel_->memoryBytes();
+        return bytes;
+    }
+
 	static Scene makeCornellBox();
 	static Scene loadFromObj(const std::string& folder, const std::string& file);
 
 private:
+    void buildLightDistribution();
+
     using mesh_size_t = std::vector<TriangleMesh>::size_type;
     using shape_size_t = std::vector<Shape>::size_type;
     using light_size_t = std::vector<Light>::size_type;
@@ -258,6 +370,13 @@ private:
     size_t triaccel8Count_;
 
     std::shared_ptr<BvhAccel> accel_;
+
+    BBox bounds_;
+
+    LightSampling lightSampling_ = LightSampling::Power;
+    AliasTable lightDistribution_;
+    LightBvh lightBvh_;
+    std::unordered_map<const Light*, int32_t> lightIndices_;
 };
 
 #endif // SCENE_H
@@ -1,6 +1,7 @@
 #if !defined(SCHEDULER_H)
 #define SCHEDULER_H
 
+#include <cstdint>
 #include <vector>
 #include <memory>
 
@@ -9,10 +10,32 @@ public:
 	virtual ~Task() { }
 
 	virtual void run() = 0;
+
+	// Called by an idle worker, while the task is running on another worker,
+	// to take over part of its remaining work. Returns nullptr if the task
+	// can't be split any further. Has to be thread safe with respect to run().
+	virtual std::unique_ptr<Task> split()
+	{
+		return nullptr;
+	}
+
+	// Estimate of the work left in the task, in seconds. The task with the
+	// most remaining work is split first.
+	virtual double remaining() const
+	{
+		return 0.0;
+	}
 };
 
 using WorkQueue = std::vector<std::unique_ptr<Task>>;
 
+struct SchedulerStats {
+    // Total time workers spent without work while tasks were unfinished
+    double idleSeconds = 0.0;
+    // Number of tasks split off running tasks by idle workers
+    uint64_t splits = 0;
+};
+
 void enqueuTasks(WorkQueue& tasks);
 
 void runTasks();
@@ -23,5 +46,10 @@ void workQueueInit();
 
 void workQueueShutdown();
 
-#endif // SCHEDULER_H
+int32_t workerCount();
 
+SchedulerStats schedulerStats();
+
+void resetSchedulerStats();
+
+#endif // SCHEDULER_H
@@ -0,0 +1,165 @@
+#if !defined(SENSOR_H)
+#define SENSOR_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+#include "bitmap.h"
+#include "spectrum.h"
+#include "vector.h"
+
+// Sums of a single pixel of a Sensor, for moving samples between sensors
+struct SensorPixel {
+    Spectrum sum;
+    float lumaSqSum;
+    uint32_t count;
+    Spectrum albedoSum;
+    Vector3f normalSum;
+};
+
+// Float accumulation film. Every pixel keeps the sum of its radiance samples,
+// the sum of squared sample luminance (for error estimation) and the number
+// of samples taken, so that samples can be added in any number of passes and
+// the current image developed at any time. The albedo and normal of the
+// surfaces seen by the samples are summed as well, as denoiser features.
+//
+// Pixels are not synchronized, only one worker at a time may add samples to a
+// given pixel.
+class Sensor {
+public:
+    Sensor(int32_t width, int32_t height)
+        : width_(width)
+        , height_(height)
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        auto size = (size_t)width_ * height_;
+        sum_.assign(size, Spectrum(0.0f));
+        lumaSqSum_.assign(size, 0.0f);
+        sampleCount_.assign(size, 0);
+        albedoSum_.assign(size, Spectrum(0.0f));
+        normalSum_.assign(size, Vector3f(0.0f));
+    }
+
+    void addSamples(int32_t x, int32_t y, const Spectrum& sum, float lumaSqSum,
+        uint32_t count, const Spectrum& albedoSum, const Vector3f& normalSum)
+    {
+        auto idx = y * width_ + x;
+        sum_[idx] += sum;
+        lumaSqSum_[idx] += lumaSqSum;
+        sampleCount_[idx] += count;
+        albedoSum_[idx] += albedoSum;
+        normalSum_[idx] += normalSum;
+    }
+
+    void addPixel(int32_t x, int32_t y, const SensorPixel& pixel)
+    {
+        addSamples(x, y, pixel.sum, pixel.lumaSqSum, pixel.count,
+            pixel.albedoSum, pixel.normalSum);
+    }
+
+    // Returns the sums of the pixel and clears it
+    SensorPixel takePixel(int32_t x, int32_t y)
+    {
+        auto idx = y * width_ + x;
+        SensorPixel pixel = { sum_[idx], lumaSqSum_[idx], sampleCount_[idx],
+            albedoSum_[idx], normalSum_[idx] };
+        sum_[idx] = Spectrum(0.0f);
+        lumaSqSum_[idx] = 0.0f;
+        sampleCount_[idx] = 0;
+        albedoSum_[idx] = Spectrum(0.0f);
+        normalSum_[idx] = Vector3f(0.0f);
+        return pixel;
+    }
+
+    Spectrum value(int32_t x, int32_t y) const
+    {
+        auto idx = y * width_ + x;
+        if (sampleCount_[idx] == 0)
+            return Spectrum(0.0f);
+        return sum_[idx] / (float)sampleCount_[idx];
+    }
+
+    uint32_t sampleCount(int32_t x, int32_t y) const
+    {
+        return sampleCount_[y * width_ + x];
+    }
+
+    // Average albedo of the surfaces seen through the pixel
+    Spectrum albedo(int32_t x, int32_t y) const
+    {
+        auto idx = y * width_ + x;
+        if (sampleCount_[idx] == 0)
+            return Spectrum(0.0f);
+        return albedoSum_[idx] / (float)sampleCount_[idx];
+    }
+
+    // Average shading normal seen through the pixel, not normalized
+    Vector3f normal(int32_t x, int32_t y) const
+    {
+        auto idx = y * width_ + x;
+        if (sampleCount_[idx] == 0)
+            return Vector3f(0.0f);
+        return normalSum_[idx] / (float)sampleCount_[idx];
+    }
+
+    // Variance of the pixel mean luminance. Pixels with less than two
+    // samples report infinite variance.
+    float meanVariance(int32_t x, int32_t y) const;
+
+    // Relative standard error of the pixel mean luminance. Pixels with less
+    // than two samples report infinite error.
+    float relativeError(int32_t x, int32_t y) const;
+
+    // Average relative error over all pixels
+    float averageError() const;
+
+    uint64_t totalSamples() const;
+
+    uint32_t minSampleCount() const;
+
+    void develop(Bitmap* bitmap) const;
+
+    // Albedo and normal images, normals mapped from [-1, 1] to [0, 1]. Should
+    // be written without tone mapping.
+    void developAlbedo(Bitmap* bitmap) const;
+
+    void developNormals(Bitmap* bitmap) const;
+
+    // Visualize the number of samples per pixel, from black (no samples)
+    // through red to white (the highest count on the sensor). The result
+    // should be written without tone mapping.
+    void developSampleCounts(Bitmap* bitmap) const;
+
+    // Raw accumulation state of every pixel, for checkpoints. read() expects
+    // a sensor of the size that was written.
+    bool write(std::ostream& out) const;
+
+    bool read(std::istream& in);
+
+    inline int32_t getWidth() const
+    {
+        return width_;
+    }
+
+    inline int32_t getHeight() const
+    {
+        return height_;
+    }
+
+private:
+    int32_t width_;
+    int32_t height_;
+
+    std::vector<Spectrum> sum_;
+    std::vector<float> lumaSqSum_;
+    std::vector<uint32_t> sampleCount_;
+    std::vector<Spectrum> albedoSum_;
+    std::vector<Vector3f> normalSum_;
+};
+
+#endif // SENSOR_H
@@ -0,0 +1,99 @@
+#if !defined(SERVER_H)
+#define SERVER_H
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "socket.h"
+
+class Scene;
+
+struct SceneCacheStats {
+    int64_t hits = 0;
+    int64_t loads = 0;
+    int64_t evictions = 0;
+    // Scene::memoryBytes of the resident scenes
+    size_t bytes = 0;
+};
+
+/*
+ * Preprocessed scenes by key, least recently used first out. Once the
+ * resident scenes take more than maxBytes, the least recently used ones are
+ * dropped, but never the scene just asked for, so a scene larger than the
+ * cap is still rendered, it just doesn't stay for long.
+ */
+class SceneCache {
+public:
+    // Returns a preprocessed scene, or nullptr if there is none
+    using Loader = std::function<std::unique_ptr<Scene>()>;
+
+    explicit SceneCache(size_t maxBytes);
+
+    ~SceneCache();
+
+    SceneCache(const SceneCache& copy) = delete;
+    SceneCache& operator=(const SceneCache& copy) = delete;
+
+    // The scene of the key, loaded with loader unless it is resident. The
+    // scene stays valid until the next call. loaded is set if the loader
+    // ran.
+    const Scene* get(const std::string& key, const Loader& loader,
+        bool* loaded = nullptr);
+
+    const SceneCacheStats& getStats() const
+    {
+        return stats_;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        std::unique_ptr<Scene> scene;
+        size_t bytes;
+    };
+
+    size_t maxBytes_;
+    // Most recently used first
+    std::list<Entry> entries_;
+    SceneCacheStats stats_;
+};
+
+/*
+ * Accepts render requests from clients and answers them with images. A
+ * request is the command line of a render, the handler renders it and fills
+ * in the encoded image and a few lines of log for the client. Requests are
+ * served one at a time, in the order they arrive, a render already uses all
+ * worker threads. A connection may carry any number of requests.
+ */
+class RenderServer {
+public:
+    // Returns false with the reason in log if the request can't be rendered
+    using Handler = std::function<bool(const std::vector<std::string>& arguments,
+        std::string* log, std::vector<char>* image)>;
+
+    bool listen(const std::string& address);
+
+    // Serves clients until one of them asks the server to stop
+    void serve(const Handler& handler);
+
+private:
+    // Returns false once the client asked the server to stop
+    bool serveClient(Socket& client, const Handler& handler);
+
+    Socket listener_;
+};
+
+// Sends a render request and waits for the image. log gets the log of the
+// server, or why the request failed.
+bool requestRender(const std::string& address,
+    const std::vector<std::string>& arguments, std::string* log,
+    std::vector<char>* image);
+
+// Asks the server at address to stop once it is done with earlier requests
+bool requestStop(const std::string& address);
+
+#endif // SERVER_H
@@ -1,6 +1,7 @@
 #if !defined(SHAPE_H)
 #define SHAPE_H
 
+#include "bbox.h"
 #include "vector.h"
 
 struct Ray;
@@ -12,9 +13,21 @@ class Shape {
 public:
     Shape() : light_(nullptr) { }
 
+    virtual ~Shape() { }
+
 	virtual bool intersect(const Ray& ray, RayHitInfo* const hitInfo) const = 0;
-	virtual Vector3f sample(float u1, float u2, float* pdf) const = 0;
+	// Samples a point on the surface as seen from reference point, returns
+	// the point, the surface normal there and the pdf per unit solid angle
+	// at the reference point
+	virtual Vector3f sample(const Vector3f& reference, float u1, float u2,
+		Vector3f* normal, float* pdf) const = 0;
+	// Solid angle pdf of sample() producing direction wi from the reference
+	// point, 0 if the direction misses the shape
+	virtual float pdf(const Vector3f& reference, const Vector3f& wi) const = 0;
+	// Samples a point uniformly by area, for emitting photons
+	virtual Vector3f sampleArea(float u1, float u2, Vector3f* normal) const = 0;
 	virtual float area() const = 0;
+    virtual BBox bounds() const = 0;
 
     void setLight(AreaLight* light)
     {
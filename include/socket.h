@@ -0,0 +1,69 @@
+#if !defined(SOCKET_H)
+#define SOCKET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Blocking stream socket, over TCP or a Unix domain socket. Addresses are
+// "unix:<path>" for a Unix domain socket, "<host>:<port>" otherwise.
+class Socket {
+public:
+    Socket()
+        : fd_(-1)
+    { }
+
+    ~Socket()
+    {
+        close();
+    }
+
+    Socket(const Socket& copy) = delete;
+    Socket& operator=(const Socket& copy) = delete;
+
+    Socket(Socket&& move);
+    Socket& operator=(Socket&& move);
+
+    // Listening socket for connect() to reach. Unix domain sockets replace a
+    // stale socket file, refuse any other existing path or a socket another
+    // process listens on, and remove their file when closed.
+    bool listen(const std::string& address);
+
+    bool connect(const std::string& address);
+
+    // Waits up to timeoutSeconds for a connection, false if none came
+    bool accept(Socket* client, double timeoutSeconds);
+
+    bool send(const void* data, size_t size);
+
+    // Fails when the peer closed the connection or the receive timeout ran
+    // out before all of size arrived
+    bool receive(void* data, size_t size);
+
+    // Receives fail after this many seconds without data, 0 waits forever
+    bool setReceiveTimeout(double seconds);
+
+    // Makes blocked and later sends and receives fail, safe to call while
+    // another thread is blocked on the socket
+    void shutdown();
+
+    void close();
+
+    bool isOpen() const
+    {
+        return fd_ >= 0;
+    }
+
+private:
+    int fd_;
+    // Socket file of a listening Unix domain socket
+    std::string unixPath_;
+};
+
+// Messages are a type and payload size followed by the payload, all in the
+// byte order of the machine
+bool sendMessage(Socket& socket, uint32_t type, const void* data, size_t size);
+
+bool receiveMessage(Socket& socket, uint32_t* type, std::vector<char>* payload);
+
+#endif // SOCKET_H
@@ -4,6 +4,7 @@
 #include <memory>
 
 #include "bsdf.h"
+#include "frame.h"
 #include "qmc.h"
 #include "shape.h"
 #include "utils.h"
@@ -96,19 +97,83 @@ public:
 		return false;
 	}
 
-	Vector3f sample(float u1, float u2, float* pdf) const override
+	// Points outside of the sphere sample the cone of directions subtended by
+	// it, so that no samples land on the far side. Points inside sample the
+	// whole surface by area.
+	Vector3f sample(const Vector3f& reference, float u1, float u2,
+		Vector3f* normal, float* pdf) const override
 	{
-		Vector3f pos = uniformSphereSample(u1, u2) * radius_;
-		pos += position_;
-		*pdf = uniformSpherePdf();
+		Vector3f toCenter = position_ - reference;
+		float distance2 = length2(toCenter);
+		float radius2 = radius_ * radius_;
+
+		if (distance2 <= radius2) {
+			Vector3f n = uniformSphereSample(u1, u2);
+			Vector3f pos = position_ + n * radius_;
+			Vector3f toPos = pos - reference;
+			float cosTheta = std::abs(dot(n, ::normal(toPos)));
+			*normal = n;
+			*pdf = cosTheta > 0.0f ? length2(toPos) / (area() * cosTheta) : 0.0f;
+			return pos;
+		}
+
+		float cosThetaMax = std::sqrt(std::max(0.0f, 1.0f - radius2 / distance2));
+		Frame coneFrame(toCenter);
+		Vector3f dir = coneFrame.toWorld(uniformConeSample(u1, u2, cosThetaMax));
+
+		// Grazing directions may numerically miss the sphere, use the closest
+		// point along the direction then
+		float b = dot(toCenter, dir);
+		float det = b * b - distance2 + radius2;
+		float t = det > 0.0f ? b - std::sqrt(det) : b;
+
+		Vector3f pos = reference + dir * t;
+		*normal = ::normal(pos - position_);
+		*pdf = uniformConePdf(cosThetaMax);
 		return pos;
 	}
 
+	float pdf(const Vector3f& reference, const Vector3f& wi) const override
+	{
+		Vector3f toCenter = position_ - reference;
+		float distance2 = length2(toCenter);
+		float radius2 = radius_ * radius_;
+
+		float b = dot(toCenter, wi);
+		float det = b * b - distance2 + radius2;
+		if (det < 0.0f)
+			return 0.0f;
+
+		if (distance2 <= radius2) {
+			float t = b + std::sqrt(det);
+			Vector3f pos = reference + wi * t;
+			float cosTheta = std::abs(dot(::normal(pos - position_), wi));
+			return cosTheta > 0.0f ? t * t / (area() * cosTheta) : 0.0f;
+		}
+
+		if (b <= 0.0f)
+			return 0.0f;
+
+		float cosThetaMax = std::sqrt(std::max(0.0f, 1.0f - radius2 / distance2));
+		return uniformConePdf(cosThetaMax);
+	}
+
+	Vector3f sampleArea(float u1, float u2, Vector3f* normal) const override
+	{
+		*normal = uniformSphereSample(u1, u2);
+		return position_ + *normal * radius_;
+	}
+
 	float area() const override
 	{
 		return 4.0f * PI * pow<2>(radius_);
 	}
 
+    BBox bounds() const override
+    {
+        return BBox(position_ - Vector3f(radius_), position_ + Vector3f(radius_));
+    }
+
 private:
 	float radius_;
 	Vector3f position_;
@@ -0,0 +1,52 @@
+#if !defined(TILE_H)
+#define TILE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "vector.h"
+
+struct Tile {
+    Vector2i start;
+    Vector2i end;
+    // Position of the tile in the tile grid, used to index per tile data like
+    // the cost map
+    Vector2i index;
+
+    Tile() { }
+    Tile(Vector2i start, Vector2i end, Vector2i index)
+        : start(start), end(end), index(index)
+    { }
+};
+
+// Order in which tiles are handed out to the workers. Curve orders keep
+// consecutively scheduled tiles close on screen, so workers running at the
+// same time touch similar parts of the scene and BVH.
+enum class TileOrder : int32_t {
+    ColumnMajor,
+    Morton,
+    Hilbert,
+    Spiral,
+    // Most expensive tile first, using the cost map of a previous pass. Falls
+    // back to Hilbert when no cost map is available.
+    CostSorted,
+};
+
+const char* tileOrderName(TileOrder order);
+
+bool parseTileOrder(const char* name, TileOrder* order);
+
+inline Vector2i tileGridSize(const Vector2i& resolution, int32_t tileSize)
+{
+    return Vector2i(
+        (resolution.x + tileSize - 1) / tileSize,
+        (resolution.y + tileSize - 1) / tileSize);
+}
+
+// Split the image into tiles of tileSize (the last row and column of tiles can
+// be smaller) and return them in the requested order. costs, if not empty,
+// holds one value per tile in the grid, row major.
+std::vector<Tile> makeTiles(const Vector2i& resolution, int32_t tileSize,
+    TileOrder order, const std::vector<float>& costs);
+
+#endif // TILE_H
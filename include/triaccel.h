@@ -140,6 +140,10 @@ inline void loadTriaccel8(
         }
     }
 
+    // All triangles fit in full chunks, there is no partially filled one
+    if (remainderTriangles == 0)
+        return;
+
     TriAccel8* accel8 = &triaccel8[num8Chunks];
     for (size_t i = 0; i < 8; ++i) {
         const TriAccel* accel = &triaccel[num8Chunks * 8 + i];
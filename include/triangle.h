@@ -180,6 +180,11 @@ public:
         return bsdf_.get();
     }
 
+    inline const BBox& getBounds() const
+    {
+        return bounds_;
+    }
+
 	const std::vector<Triangle>& getTriangles() const
 	{
 		return triangles_;
@@ -190,6 +195,14 @@ public:
 		return vertices_;
 	}
 
+    // Heap memory of the geometry
+    size_t memoryBytes() const
+    {
+        return vertices_.capacity() * sizeof(Vector3f)
+            + normals_.capacity() * sizeof(Vector3f)
+            + triangles_.capacity() * sizeof(Triangle);
+    }
+
 private:
 
     std::vector<Vector3f> vertices_;
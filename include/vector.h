@@ -241,6 +241,9 @@ struct Ray {
     Vector3f dir;
 	float maxT;
 
+    // Uninitialized, for arrays of rays filled in later
+    Ray() = default;
+
     Ray(Vector3f o, Vector3f d)
 		: orig(o)
 		, minT(0.0f)
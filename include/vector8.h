@@ -39,6 +39,12 @@ struct BoolVector8
         return _mm256_movemask_ps(ymm) == 0x00;
     }
 
+    // One bit per lane, lane 0 in the lowest bit
+    FINLINE uint32_t mask() const
+    {
+        return (uint32_t)_mm256_movemask_ps(ymm);
+    }
+
     FINLINE BoolVector8 operator!() const
     {
         return BoolVector8(_mm256_xor_ps(_mm256_set1_ps(convertBits<int, float>(0xffffffff)), ymm));
@@ -267,4 +273,15 @@ static FINLINE Vector8 fmsub(const Vector8& mulLhs, const Vector8& mulRhs, const
 #endif
 }
 
+// Both return rhs when either lane is NaN
+static FINLINE Vector8 min(const Vector8& lhs, const Vector8& rhs)
+{
+    return Vector8(_mm256_min_ps(lhs.ymm, rhs.ymm));
+}
+
+static FINLINE Vector8 max(const Vector8& lhs, const Vector8& rhs)
+{
+    return Vector8(_mm256_max_ps(lhs.ymm, rhs.ymm));
+}
+
 #endif // VECTOR8_H
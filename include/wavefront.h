@@ -0,0 +1,330 @@
+#if !defined(WAVEFRONT_H)
+#define WAVEFRONT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "bbox.h"
+#include "bsdf.h"
+#include "integrator.h"
+#include "platform.h"
+#include "scene.h"
+#include "spectrum.h"
+
+// State of a path of the wavefront integrator between bounces. Every path
+// carries its own sampler, started at its pixel sample.
+template <typename TSampler>
+struct WavefrontPath {
+    WavefrontPath(const Ray& ray, const TSampler& sampler)
+        : ray(ray)
+        , sampler(sampler)
+    { }
+
+    Ray ray;
+    TSampler sampler;
+    Spectrum color { 0.0f };
+    Spectrum pathWeight { 1.0f };
+    RayHitInfo isect;
+    // Previous bounce, for weighting emission found by BSDF sampling
+    Vector3f previousPosition;
+    Vector3f previousNormal;
+    float bsdfPdf = 0.0f;
+    bool specularBounce = true;
+    PixelFeatures features;
+    bool featuresDone = false;
+};
+
+// Sort key of a ray and the path it belongs to
+struct RayKey {
+    uint64_t key;
+    uint32_t index;
+};
+
+// Path index lists of the stages, kept by the caller between batches so that
+// they are allocated once per worker
+struct WavefrontQueues {
+    // Paths to extend by the next bounce
+    std::vector<uint32_t> active;
+    // Paths that hit a surface with a BSDF, in the order of their hits
+    std::vector<uint32_t> hits;
+    // The same paths, grouped by BSDF type
+    std::vector<uint32_t> sorted;
+    // Keys of the active rays when they are binned
+    std::vector<RayKey> keys;
+};
+
+// Spread the lower 10 bits of v, leaving two zero bits between each of them
+FINLINE uint32_t spreadBits3(uint32_t v)
+{
+    v &= 0x000003ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// Orders rays by direction octant, then by the Morton code of the origin on a
+// 1024^3 grid over the scene bounds, then by a coarse direction within the
+// octant. Rays close in the order start in the same region heading the same
+// way, so they tend to visit the same BVH nodes.
+FINLINE uint64_t rayKey(const Ray& ray, const BBox& bounds,
+    const Vector3f& gridScale)
+{
+    using std::abs;
+
+    auto quantize = [](float v, float scale) {
+        return (uint32_t)std::min(std::max(v * scale, 0.0f), scale);
+    };
+
+    auto origin = ray.orig - bounds.min;
+    uint32_t morton = spreadBits3(quantize(origin.x, gridScale.x))
+        | (spreadBits3(quantize(origin.y, gridScale.y)) << 1)
+        | (spreadBits3(quantize(origin.z, gridScale.z)) << 2);
+
+    uint64_t octant = (ray.dir.x < 0.0f ? 1 : 0)
+        | (ray.dir.y < 0.0f ? 2 : 0)
+        | (ray.dir.z < 0.0f ? 4 : 0);
+
+    uint64_t direction = (quantize(abs(ray.dir.x), 63.0f) << 6)
+        | quantize(abs(ray.dir.y), 63.0f);
+
+    return (octant << 42) | ((uint64_t)morton << 12) | direction;
+}
+
+/*
+ * Path tracer that advances a whole batch of paths one bounce at a time,
+ * computing the same estimate as PathTracer without its radiance cache,
+ * caustic photons and guiding, which the wavefront tracer doesn't support.
+ * Every bounce first intersects all active paths, then groups the hits by
+ * BSDF type and shades each group in a loop specialized on the concrete Bsdf
+ * class. The shading loops call the BSDF directly and fold the isDelta
+ * checks, and the instructions of a single material stay hot in the cache
+ * for the whole group.
+ */
+class WavefrontPathTracer {
+public:
+    WavefrontPathTracer(const IntegratorSettings& settings)
+        : maxDepth_(settings.maxDepth)
+        , batchSize_(std::max(1, settings.batchSize))
+        , rayBinSize_(std::max(0, settings.rayBinSize))
+        , mis_(settings.mis)
+        , lightSamples_(std::min(std::max(settings.lightSamples, 1),
+            maxLightSamples))
+    { }
+
+    int32_t batchSize() const
+    {
+        return batchSize_;
+    }
+
+    // Traces the camera rays of the paths, adding the radiance to their color
+    template <typename TSampler>
+    void li(const Scene& scene, std::vector<WavefrontPath<TSampler>>& paths,
+        WavefrontQueues* queues, uint64_t* rays) const
+    {
+        auto& active = queues->active;
+        auto& hits = queues->hits;
+        auto& sorted = queues->sorted;
+
+        active.resize(paths.size());
+        for (size_t i = 0; i < paths.size(); ++i) {
+            active[i] = (uint32_t)i;
+        }
+
+        for (auto bounce = 0; bounce < maxDepth_ && !active.empty(); ++bounce) {
+            // Camera rays are coherent already, in pixel order
+            if (bounce > 0 && rayBinSize_ > 0)
+                binRays(scene, paths, queues);
+
+            uint32_t typeCounts[bsdfTypeCount] = { };
+
+            hits.clear();
+            for (auto index : active) {
+                auto& path = paths[index];
+                ++*rays;
+                if (!scene.intersect(path.ray, &path.isect))
+                    continue;
+
+                if (!path.featuresDone)
+                    path.featuresDone = recordFeatures(path.isect, &path.features);
+
+                addEmission(scene, &path);
+
+                if (!path.isect.bsdf)
+                    continue;
+
+                hits.push_back(index);
+                ++typeCounts[(int32_t)path.isect.bsdf->type()];
+            }
+
+            // Counting sort of the hits by BSDF type
+            uint32_t typeOffsets[bsdfTypeCount];
+            uint32_t offset = 0;
+            for (int32_t type = 0; type < bsdfTypeCount; ++type) {
+                typeOffsets[type] = offset;
+                offset += typeCounts[type];
+            }
+
+            sorted.resize(hits.size());
+            for (auto index : hits) {
+                auto type = (int32_t)paths[index].isect.bsdf->type();
+                sorted[typeOffsets[type]++] = index;
+            }
+
+            active.clear();
+            const auto* group = sorted.data();
+            for (int32_t type = 0; type < bsdfTypeCount; ++type) {
+                shadeGroup(scene, (BsdfType)type, paths, group, typeCounts[type],
+                    &active, rays);
+                group += typeCounts[type];
+            }
+        }
+    }
+
+private:
+    // Sorts the active paths by rayKey in runs of rayBinSize_ rays
+    template <typename TSampler>
+    void binRays(const Scene& scene,
+        const std::vector<WavefrontPath<TSampler>>& paths,
+        WavefrontQueues* queues) const
+    {
+        auto& active = queues->active;
+        auto& keys = queues->keys;
+
+        const auto& bounds = scene.getBounds();
+        auto extent = bounds.max - bounds.min;
+        auto gridScale = Vector3f(
+            extent.x > 0.0f ? 1023.0f / extent.x : 0.0f,
+            extent.y > 0.0f ? 1023.0f / extent.y : 0.0f,
+            extent.z > 0.0f ? 1023.0f / extent.z : 0.0f);
+
+        keys.resize(active.size());
+        for (size_t i = 0; i < active.size(); ++i) {
+            keys[i] = { rayKey(paths[active[i]].ray, bounds, gridScale), active[i] };
+        }
+
+        auto binSize = (size_t)rayBinSize_;
+        for (size_t begin = 0; begin < keys.size(); begin += binSize) {
+            auto end = std::min(keys.size(), begin + binSize);
+            std::sort(keys.begin() + begin, keys.begin() + end,
+                [](const RayKey& a, const RayKey& b) { return a.key < b.key; });
+        }
+
+        for (size_t i = 0; i < keys.size(); ++i) {
+            active[i] = keys[i].index;
+        }
+    }
+
+    template <typename TSampler>
+    FINLINE void addEmission(const Scene& scene, WavefrontPath<TSampler>* path) const
+    {
+        const auto& isect = path->isect;
+        if (!isect.areaLight || dot(isect.normal, path->ray.dir) >= 0.0f)
+            return;
+
+        auto emission = path->pathWeight * isect.areaLight->intensity();
+        if (path->specularBounce) {
+            path->color += emission;
+        } else if (mis_) {
+            float lightPdf = scene.lightPmf(path->previousPosition,
+                path->previousNormal, isect.areaLight)
+                * isect.areaLight->pdf(path->previousPosition, path->ray.dir);
+            path->color += emission * powerHeuristic(path->bsdfPdf,
+                lightSamples_ * lightPdf);
+        }
+    }
+
+    template <typename TSampler>
+    void shadeGroup(const Scene& scene, BsdfType type,
+        std::vector<WavefrontPath<TSampler>>& paths, const uint32_t* group,
+        uint32_t count, std::vector<uint32_t>* active, uint64_t* rays) const
+    {
+        if (count == 0)
+            return;
+
+        switch (type) {
+        case BsdfType::Lambertian:
+            shade<Lambertian>(scene, paths, group, count, active, rays);
+            break;
+        case BsdfType::PerfectConductor:
+            shade<PerfectConductor>(scene, paths, group, count, active, rays);
+            break;
+        case BsdfType::PerfectDielectric:
+            shade<PerfectDielectric>(scene, paths, group, count, active, rays);
+            break;
+        case BsdfType::FresnelConductor:
+            shade<FresnelConductor>(scene, paths, group, count, active, rays);
+            break;
+        case BsdfType::FresnelDielectric:
+            shade<FresnelDielectric>(scene, paths, group, count, active, rays);
+            break;
+        case BsdfType::TorranceSparrowConductor:
+            shade<TorranceSparrowConductor>(scene, paths, group, count, active,
+                rays);
+            break;
+        }
+    }
+
+    // Direct lighting and the BSDF sampled continuation of paths whose hits
+    // all have a TBsdf. Draws from the sampler in the order of PathTracer.
+    template <typename TBsdf, typename TSampler>
+    void shade(const Scene& scene, std::vector<WavefrontPath<TSampler>>& paths,
+        const uint32_t* group, uint32_t count, std::vector<uint32_t>* active,
+        uint64_t* rays) const
+    {
+        using std::abs;
+
+        for (uint32_t i = 0; i < count; ++i) {
+            auto& path = paths[group[i]];
+            const auto& bsdf = static_cast<const TBsdf&>(*path.isect.bsdf);
+            SurfaceHit hit(path.ray, path.isect);
+
+            if (!bsdf.isDelta()) {
+                path.color += path.pathWeight * sampleLights(scene, bsdf, hit,
+                    path.sampler, rays, mis_, lightSamples_);
+            } else {
+                skipLightSamples(path.sampler, lightSamples_);
+            }
+
+            // Weights above one always continue, as in PathTracer
+            float continueProbability = std::min(1.0f, path.pathWeight.y());
+            if (path.sampler.get1D() > continueProbability)
+                continue;
+
+            path.pathWeight /= continueProbability;
+            Vector3f wi;
+            float pdf;
+            auto u = path.sampler.get2D();
+            Spectrum refl = bsdf.sample(hit.wo, &wi, u.x, u.y, &pdf);
+
+            if (refl.y() == 0.0f || pdf == 0.0f)
+                continue;
+
+            path.specularBounce = bsdf.isDelta();
+            path.bsdfPdf = pdf;
+            path.previousPosition = hit.position;
+            path.previousNormal = hit.nl;
+
+            Vector3f dir = hit.frame.toWorld(wi);
+
+            path.pathWeight = path.pathWeight * refl * abs(dot(dir, hit.nl)) / pdf;
+            path.ray = { hit.position + dir * EPS, dir };
+            active->push_back(group[i]);
+        }
+    }
+
+    int32_t maxDepth_;
+    int32_t batchSize_;
+    int32_t rayBinSize_;
+    bool mis_;
+    int32_t lightSamples_;
+};
+
+template <>
+struct IsBatched<WavefrontPathTracer> {
+    static constexpr bool value = true;
+};
+
+#endif // WAVEFRONT_H
@@ -11,15 +11,15 @@ static uint8_t toneMap(float val)
 	return std::min(max, (uint8_t)(std::pow(1 - std::exp(-val), 1.0f / 2.2f) * 255 + 0.5f));
 }
 
-bool Bitmap::write(const std::string& name)
+static uint8_t clampToByte(float val)
 {
-	bool success = false;
+	return (uint8_t)(std::min(1.0f, std::max(0.0f, val)) * 255 + 0.5f);
+}
 
+void Bitmap::encode(std::vector<char>* bytes, bool toneMapped) const
+{
 	int32_t rowSize = ((24 * width_ + 31) / 32) * 4;
 	int32_t paddingSize = rowSize - (width_ * 3);
-	uint8_t padding[] = { 0, 0, 0 };
-
-	std::ofstream out(name, std::ios::out | std::ios::binary);
 
 	BitmapMagic magic = { { 'B', 'M' } };
 
@@ -44,29 +44,46 @@ bool Bitmap::write(const std::string& name)
 	infoHeader.numColors = 0;
 	infoHeader.numImportantColors = 0;
 
-	out.write(reinterpret_cast<char*>(&magic), sizeof(BitmapMagic));
+	bytes->clear();
+	bytes->reserve(fileHeader.size);
+
+	auto append = [bytes](const void* data, size_t size) {
+		auto begin = reinterpret_cast<const char*>(data);
+		bytes->insert(bytes->end(), begin, begin + size);
+	};
 
-	out.write(reinterpret_cast<char*>(&fileHeader), sizeof(BitmapFileHeader));
+	append(&magic, sizeof(BitmapMagic));
 
-	out.write(reinterpret_cast<char*>(&infoHeader), sizeof(BitmapInfoHeader));
+	append(&fileHeader, sizeof(BitmapFileHeader));
+
+	append(&infoHeader, sizeof(BitmapInfoHeader));
 
 	uint8_t color[3];
+	uint8_t padding[] = { 0, 0, 0 };
+	auto convert = toneMapped ? toneMap : clampToByte;
 
 	for (int32_t i = height_ - 1; i >= 0; --i) {
 		for (int32_t j = 0; j < width_; ++j) {
 			const RGBColor& bufVal = buffer_[i * width_ + j];
-			color[0] = toneMap(bufVal.b);
-			color[1] = toneMap(bufVal.g);
-			color[2] = toneMap(bufVal.r);
+			color[0] = convert(bufVal.b);
+			color[1] = convert(bufVal.g);
+			color[2] = convert(bufVal.r);
 
-			out.write(reinterpret_cast<char*>(color), sizeof(color));
+			append(color, sizeof(color));
 		}
-		if (padding > 0) {
-			out.write(reinterpret_cast<char*>(padding), paddingSize);
+		if (paddingSize > 0) {
+			append(padding, paddingSize);
 		}
 	}
+}
 
-	success = true;
+bool Bitmap::write(const std::string& name, bool toneMapped)
+{
+	std::vector<char> bytes;
+	encode(&bytes, toneMapped);
+
+	std::ofstream out(name, std::ios::out | std::ios::binary);
+	out.write(bytes.data(), bytes.size());
 
-	return success;
+	return (bool)out;
 }
@@ -73,13 +73,24 @@ void Blinn::sample(const Vector3f& wo, Vector3f* wi, float u1,
     *pdf = blinnPdf;
 }
 
+float Blinn::pdf(const Vector3f& wo, const Vector3f& wi) const
+{
+    Vector3f wh = normal(wo + wi);
+    float woDotWh = dot(wo, wh);
+    if (woDotWh <= 0.0f)
+        return 0.0f;
+
+    return ((exponent_ + 1.0f) * std::pow(absCosTheta(wh), exponent_)) /
+        (2.0f * PI * 4.0f * woDotWh);
+}
+
 /*
  * Lambertian
  */
 Spectrum Lambertian::f(const Vector3f& wo, const Vector3f& wi) const
 {
-	UNUSED(wo);
-	UNUSED(wi);
+    if (!sameHemisphere(wo, wi))
+        return Spectrum(0.0f, 0.0f, 0.0f);
     return reflectance_ * INV_PI;
 }
 
@@ -94,6 +105,11 @@ Spectrum Lambertian::sample(const Vector3f& wo, Vector3f* wi, float u1,
     return f(wo, *wi);
 }
 
+float Lambertian::pdf(const Vector3f& wo, const Vector3f& wi) const
+{
+    return sameHemisphere(wo, wi) ? absCosTheta(wi) * INV_PI : 0.0f;
+}
+
 /*
  * Perfect conductor
  */
@@ -118,6 +134,13 @@ Spectrum PerfectConductor::sample(const Vector3f& wo, Vector3f* wi, float u1,
     return reflectance_ / absCosTheta(*wi);
 }
 
+float PerfectConductor::pdf(const Vector3f& wo, const Vector3f& wi) const
+{
+	UNUSED(wo);
+	UNUSED(wi);
+    return 0.0f;
+}
+
 /*
  * Perfect dielectric
  */
@@ -153,6 +176,13 @@ Spectrum PerfectDielectric::sample(const Vector3f& wo, Vector3f* wi, float u1,
     return reflectance_ / absCosTheta(*wi);
 }
 
+float PerfectDielectric::pdf(const Vector3f& wo, const Vector3f& wi) const
+{
+	UNUSED(wo);
+	UNUSED(wi);
+    return 0.0f;
+}
+
 /*
  * Fresnel conductor
  */
@@ -178,6 +208,13 @@ Spectrum FresnelConductor::sample(const Vector3f& wo, Vector3f* wi, float u1,
         / absCosTheta(*wi);
 }
 
+float FresnelConductor::pdf(const Vector3f& wo, const Vector3f& wi) const
+{
+	UNUSED(wo);
+	UNUSED(wi);
+    return 0.0f;
+}
+
 /*
  * Fresnel dielectric
  */
@@ -200,6 +237,7 @@ Spectrum FresnelDielectric::sample(const Vector3f& wo, Vector3f* wi, float u1,
     // total internal reflection, reflect ray
     if (sint2 > 1.0f) {
         *wi = Vector3f(-wo.x, -wo.y, wo.z);
+        *pdf = 1.0f;
         if (absCosTheta(*wi) < EPS)
             return Spectrum(0.0f);
         return reflectance_ / absCosTheta(*wi);
@@ -237,6 +275,13 @@ Spectrum FresnelDielectric::sample(const Vector3f& wo, Vector3f* wi, float u1,
     }
 }
 
+float FresnelDielectric::pdf(const Vector3f& wo, const Vector3f& wi) const
+{
+	UNUSED(wo);
+	UNUSED(wi);
+    return 0.0f;
+}
+
 
 /*
  * TorranceSparrow microfacet brdf for conductors
@@ -265,6 +310,13 @@ Spectrum TorranceSparrowConductor::sample(const Vector3f& wo, Vector3f* wi,
     return f(wo, *wi);
 }
 
+float TorranceSparrowConductor::pdf(const Vector3f& wo, const Vector3f& wi) const
+{
+    if (!sameHemisphere(wo, wi))
+        return 0.0f;
+    return distribution_->pdf(wo, wi);
+}
+
 float TorranceSparrowConductor::G(const Vector3f& wo, const Vector3f& wi,
     const Vector3f& wh) const
 {
@@ -1,5 +1,7 @@
 #include "bvhaccel.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 
 #include "bbox.h"
@@ -304,10 +306,107 @@ bool traverse(const std::vector<BvhAccel::FlattenedBvhNode>& flattenedTree,
     return hit;
 }
 
+// Any hit traversal of a packet of up to 8 rays. The rays are kept in SoA
+// form, so every node is fetched once and tested against all the rays that
+// reach it with a single 8 wide slab test, and a ray leaves the packet as soon
+// as something occludes it. Works best on coherent rays, like the shadow rays
+// of a single shading point.
+void traverseShadowPacket(
+    const std::vector<BvhAccel::FlattenedBvhNode>& flattenedTree,
+    const Ray* rays, int32_t count, const TriAccel* triangles, bool* occluded)
+{
+    alignas(32) float packet[8][8];
+    uint32_t active = 0;
+    for (int32_t i = 0; i < 8; ++i) {
+        // Unused lanes get an empty interval and never hit
+        const auto& ray = rays[std::min(i, count - 1)];
+        packet[0][i] = ray.orig.x;
+        packet[1][i] = ray.orig.y;
+        packet[2][i] = ray.orig.z;
+        packet[3][i] = 1.0f / ray.dir.x;
+        packet[4][i] = 1.0f / ray.dir.y;
+        packet[5][i] = 1.0f / ray.dir.z;
+        packet[6][i] = i < count ? ray.minT : INFINITY;
+        packet[7][i] = i < count ? ray.maxT : -INFINITY;
+        if (i < count && !occluded[i])
+            active |= 1u << i;
+    }
+
+    const Vector8 orig[3] = { Vector8(packet[0]), Vector8(packet[1]),
+        Vector8(packet[2]) };
+    const Vector8 invDir[3] = { Vector8(packet[3]), Vector8(packet[4]),
+        Vector8(packet[5]) };
+    const Vector8 minT(packet[6]);
+    const Vector8 maxT(packet[7]);
+
+    // Every stack entry keeps the rays that reached its parent
+    size_t stackOffset = 0;
+    size_t stack[64];
+    uint32_t stackMask[64];
+    size_t currentNode = 0;
+    uint32_t mask = active;
+
+    while (active != 0) {
+        const auto& node = flattenedTree[currentNode];
+
+        auto tNear = minT;
+        auto tFar = maxT;
+        for (int32_t axis = 0; axis < 3; ++axis) {
+            auto t0 = (Vector8(node.bounds.min[axis]) - orig[axis]) * invDir[axis];
+            auto t1 = (Vector8(node.bounds.max[axis]) - orig[axis]) * invDir[axis];
+            // NaN slabs, from a ray in the plane of a face, leave the
+            // interval as it is
+            tNear = max(min(t0, t1), tNear);
+            tFar = min(max(t0, t1), tFar);
+        }
+
+        // Rays occluded since the entry was pushed are dropped here
+        uint32_t hitMask = (tNear <= tFar).mask() & mask & active;
+
+        if (hitMask != 0 && node.splitAxis != SplitAxis::None) {
+            // Near child first, as seen by the first ray of the packet
+            auto first = __builtin_ctz(hitMask);
+            if (rays[first].dir[node.splitAxis] > 0) {
+                currentNode = currentNode + 1;
+                stack[stackOffset] = node.childOffset;
+            } else {
+                stack[stackOffset] = currentNode + 1;
+                currentNode = node.childOffset;
+            }
+            stackMask[stackOffset] = hitMask;
+            stackOffset++;
+            mask = hitMask;
+            continue;
+        }
+
+        for (size_t t = 0; t < node.numTriangles && hitMask != 0; ++t) {
+            const auto& triangle = triangles[node.triangleOffset + t];
+            for (auto bits = hitMask; bits != 0; bits &= bits - 1) {
+                auto i = __builtin_ctz(bits);
+                RayHitInfo isect;
+                isect.t = rays[i].maxT;
+                if (intersect(triangle, rays[i], &isect)) {
+                    occluded[i] = true;
+                    active &= ~(1u << i);
+                    hitMask &= ~(1u << i);
+                }
+            }
+        }
+
+        if (stackOffset == 0)
+            return;
+        --stackOffset;
+        currentNode = stack[stackOffset];
+        mask = stackMask[stackOffset];
+    }
+}
+
 } // anonymous namespace
 
 BvhAccel::BvhAccel(const Scene& scene)
-    : scene_(scene)
+    : triangles_(nullptr)
+    , triangleCount_(0)
+    , scene_(scene)
 {
     using std::get;
 
@@ -352,6 +451,7 @@ BvhAccel::BvhAccel(const Scene& scene)
     auto root_ = buildRecursive(buildData.begin(), buildData.end(), triangles);
 
     triangles_ = alignedAlloc<TriAccel>(numTriangles, 16);
+    triangleCount_ = numTriangles;
     for (size_t i = 0; i < numTriangles; ++i) {
         MeshTrianglePair tri = triangles[i];
         const auto& m = scene.getTriangleMeshes()[get<0>(tri)];
@@ -367,6 +467,12 @@ BvhAccel::~BvhAccel()
     alignedFree(triangles_);
 }
 
+size_t BvhAccel::memoryBytes() const
+{
+    return optimizedAccel_.capacity() * sizeof(FlattenedBvhNode)
+        + triangleCount_ * sizeof(TriAccel);
+}
+
 bool BvhAccel::intersect(const Ray& ray, RayHitInfo* const isect) const
 {
     return traverse<false>(optimizedAccel_, ray, triangles_, scene_.getTriangleMeshes(), isect);
@@ -380,3 +486,12 @@ bool BvhAccel::intersectShadow(const Ray& ray) const
     return traverse<true>(optimizedAccel_, ray, triangles_, scene_.getTriangleMeshes(), &isect);
 }
 
+void BvhAccel::intersectShadow(const Ray* rays, int32_t count,
+    bool* occluded) const
+{
+    for (int32_t begin = 0; begin < count; begin += maxPacketSize) {
+        auto size = std::min(maxPacketSize, count - begin);
+        traverseShadowPacket(optimizedAccel_, rays + begin, size, triangles_,
+            occluded + begin);
+    }
+}
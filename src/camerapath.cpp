@@ -0,0 +1,89 @@
+#include "camerapath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "constants.h"
+
+bool readCameraPath(const std::string& name, std::vector<CameraPose>* poses)
+{
+    std::ifstream in(name);
+    if (!in) {
+        printf("Can't open camera path %s\n", name.c_str());
+        return false;
+    }
+
+    poses->clear();
+    std::string line;
+    for (int32_t lineNumber = 1; std::getline(in, line); ++lineNumber) {
+        auto first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+
+        std::istringstream values(line);
+        CameraPose pose;
+        if (!(values >> pose.position.x >> pose.position.y >> pose.position.z
+            >> pose.target.x >> pose.target.y >> pose.target.z)) {
+            printf("%s:%d: expected px py pz tx ty tz\n", name.c_str(),
+                lineNumber);
+            return false;
+        }
+
+        if (length2(pose.target - pose.position) == 0.0f) {
+            printf("%s:%d: the camera looks at its own position\n",
+                name.c_str(), lineNumber);
+            return false;
+        }
+        poses->push_back(pose);
+    }
+
+    if (poses->empty()) {
+        printf("No poses in camera path %s\n", name.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::vector<CameraPose> sampleCameraPath(const std::vector<CameraPose>& keyframes,
+    int32_t frameCount)
+{
+    std::vector<CameraPose> poses;
+    if (keyframes.size() < 2) {
+        poses.assign(keyframes.empty() ? 0 : (size_t)frameCount,
+            keyframes.empty() ? CameraPose() : keyframes[0]);
+        return poses;
+    }
+
+    auto segments = (int32_t)keyframes.size() - 1;
+    for (int32_t frame = 0; frame < frameCount; ++frame) {
+        auto t = frameCount > 1
+            ? (float)frame / (float)(frameCount - 1) * (float)segments : 0.0f;
+        // The last frame ends the last segment
+        auto segment = std::min((int32_t)t, segments - 1);
+        auto u = t - (float)segment;
+        const auto& a = keyframes[segment];
+        const auto& b = keyframes[segment + 1];
+        poses.push_back({ a.position * (1.0f - u) + b.position * u,
+            a.target * (1.0f - u) + b.target * u });
+    }
+    return poses;
+}
+
+std::vector<CameraPose> turntablePath(const Vector3f& start,
+    const Vector3f& center, int32_t frameCount)
+{
+    auto offset = start - center;
+    std::vector<CameraPose> poses;
+    for (int32_t frame = 0; frame < frameCount; ++frame) {
+        auto angle = 2.0f * PI * (float)frame / (float)frameCount;
+        auto c = std::cos(angle);
+        auto s = std::sin(angle);
+        Vector3f rotated(offset.x * c + offset.z * s, offset.y,
+            offset.z * c - offset.x * s);
+        poses.push_back({ center + rotated, center });
+    }
+    return poses;
+}
@@ -0,0 +1,194 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include "renderer.h"
+
+namespace {
+
+constexpr char checkpointMagic[4] = { 'R', 'T', 'C', 'K' };
+constexpr uint32_t checkpointVersion = 2;
+
+// Sensor arrays are written as they are in memory
+static_assert(sizeof(Spectrum) == 3 * sizeof(float), "Spectrum has padding");
+static_assert(sizeof(Vector3f) == 3 * sizeof(float), "Vector3f has padding");
+
+struct CheckpointHeader {
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t integrator;
+    int32_t sampler;
+    int32_t samplesPerPixel;
+    int32_t passes;
+    int32_t firstSample;
+};
+
+// Reads and checks the header, leaves the stream at the sensor
+bool readHeader(std::istream& in, const std::string& name,
+    CheckpointInfo* info)
+{
+    CheckpointHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in.good()
+        || !std::equal(checkpointMagic, checkpointMagic + 4, header.magic)) {
+        printf("Not a checkpoint: %s\n", name.c_str());
+        return false;
+    }
+
+    if (header.version != checkpointVersion) {
+        printf("Unsupported checkpoint version %u\n", header.version);
+        return false;
+    }
+
+    info->width = header.width;
+    info->height = header.height;
+    info->integrator = (IntegratorType)header.integrator;
+    info->sampler = (SamplerType)header.sampler;
+    info->samplesPerPixel = header.samplesPerPixel;
+    info->passes = header.passes;
+    info->firstSample = header.firstSample;
+    return true;
+}
+
+} // anonymous namespace
+
+CheckpointInfo checkpointInfo(const RenderSettings& settings,
+    const Sensor& sensor, int32_t passes, int32_t firstSample)
+{
+    CheckpointInfo info;
+    info.width = sensor.getWidth();
+    info.height = sensor.getHeight();
+    info.integrator = settings.integrator.type;
+    info.sampler = settings.sampler;
+    info.samplesPerPixel = settings.samplesPerPixel;
+    info.passes = passes;
+    info.firstSample = firstSample;
+    return info;
+}
+
+bool writeCheckpoint(const std::string& name, const CheckpointInfo& info,
+    const Sensor& sensor)
+{
+    CheckpointHeader header;
+    std::copy(checkpointMagic, checkpointMagic + 4, header.magic);
+    header.version = checkpointVersion;
+    header.width = info.width;
+    header.height = info.height;
+    header.integrator = (int32_t)info.integrator;
+    header.sampler = (int32_t)info.sampler;
+    header.samplesPerPixel = info.samplesPerPixel;
+    header.passes = info.passes;
+    header.firstSample = info.firstSample;
+
+    auto tempName = name + ".tmp";
+    {
+        std::ofstream out(tempName, std::ios::out | std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!sensor.write(out)) {
+            printf("Failed to write checkpoint %s\n", tempName.c_str());
+            return false;
+        }
+    }
+
+    if (std::rename(tempName.c_str(), name.c_str()) != 0) {
+        printf("Failed to replace checkpoint %s\n", name.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool readCheckpoint(const std::string& name, CheckpointInfo* info,
+    Sensor* sensor)
+{
+    std::ifstream in(name, std::ios::in | std::ios::binary);
+    CheckpointInfo header;
+    if (!readHeader(in, name, &header))
+        return false;
+
+    if (header.width != sensor->getWidth()
+        || header.height != sensor->getHeight()) {
+        printf("Checkpoint is %dx%d, the image %dx%d\n", header.width,
+            header.height, sensor->getWidth(), sensor->getHeight());
+        return false;
+    }
+
+    if (!sensor->read(in)) {
+        printf("Truncated checkpoint: %s\n", name.c_str());
+        return false;
+    }
+
+    *info = header;
+    return true;
+}
+
+bool readCheckpointInfo(const std::string& name, CheckpointInfo* info)
+{
+    std::ifstream in(name, std::ios::in | std::ios::binary);
+    return readHeader(in, name, info);
+}
+
+CheckpointWriter::CheckpointWriter(const std::string& name)
+    : name_(name)
+    , writing_(false)
+    , shuttingDown_(false)
+{
+    thread_ = std::thread([this]() { run(); });
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        shuttingDown_ = true;
+    }
+    condition_.notify_all();
+    thread_.join();
+}
+
+void CheckpointWriter::submit(const CheckpointInfo& info, const Sensor& sensor)
+{
+    // Copy outside the lock, the writer thread may hold it for a while
+    auto snapshot = std::make_unique<Sensor>(sensor);
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        pending_ = std::move(snapshot);
+        pendingInfo_ = info;
+    }
+    condition_.notify_all();
+}
+
+void CheckpointWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (pending_ || writing_) {
+        condition_.wait(lock);
+    }
+}
+
+void CheckpointWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        while (!pending_ && !shuttingDown_) {
+            condition_.wait(lock);
+        }
+        if (!pending_)
+            return;
+
+        auto sensor = std::move(pending_);
+        auto info = pendingInfo_;
+        writing_ = true;
+        lock.unlock();
+
+        writeCheckpoint(name_, info, *sensor);
+        sensor.reset();
+
+        lock.lock();
+        writing_ = false;
+        condition_.notify_all();
+    }
+}
@@ -0,0 +1,315 @@
+#include "denoiser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <memory>
+
+#include <immintrin.h>
+
+#include "platform.h"
+#include "scheduler.h"
+#include "sensor.h"
+#include "vector8.h"
+
+// types, constants and helpers internal to the file
+namespace {
+
+// B3 spline, the a-trous kernel is its outer product
+const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f,
+    1.0f / 16.0f };
+
+// Variance used for pixels without an estimate, lets everything through the
+// luminance weight
+const float unknownVariance = 1e20f;
+
+// Keeps the luminance weight finite for noise free pixels
+const float colorEpsilon = 1e-4f;
+
+// Image planes of the filter. Every plane has a border of invalid pixels
+// wide enough for the largest tap step, and rows are padded to a multiple of
+// 8 pixels, so that the filter loads 8 neighbours without bounds checks.
+struct Planes {
+    int32_t width;
+    int32_t height;
+    int32_t border;
+    int32_t stride;
+    int32_t rows;
+
+    // 1 inside the image, 0 in the border
+    std::vector<float> valid;
+    std::vector<float> normal[3];
+    std::vector<float> albedo[3];
+    // Ping pong buffers of the filtered color and its variance
+    std::vector<float> color[2][3];
+    std::vector<float> variance[2];
+    // Variance blurred over 3 x 3 pixels, drives the luminance weight
+    std::vector<float> weightVariance;
+
+    size_t index(int32_t x, int32_t y) const
+    {
+        return (size_t)(y + border) * stride + x + border;
+    }
+};
+
+FINLINE Vector8 load(const std::vector<float>& plane, size_t idx)
+{
+    return Vector8(_mm256_loadu_ps(plane.data() + idx));
+}
+
+FINLINE void store(std::vector<float>& plane, size_t idx, const Vector8& v)
+{
+    _mm256_storeu_ps(plane.data() + idx, v.ymm);
+}
+
+FINLINE Vector8 abs(const Vector8& v)
+{
+    return Vector8(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), v.ymm));
+}
+
+FINLINE Vector8 luminance(const Vector8& r, const Vector8& g, const Vector8& b)
+{
+    return fmadd(Vector8(0.2126f), r,
+        fmadd(Vector8(0.7152f), g, Vector8(0.0722f) * b));
+}
+
+// e^x for x <= 0, Cephes style polynomial with a relative error below 1e-6
+FINLINE Vector8 fastExp(const Vector8& x)
+{
+    auto v = Vector8(_mm256_max_ps(x.ymm, _mm256_set1_ps(-87.0f)));
+    auto n = Vector8(_mm256_round_ps((v * Vector8(1.44269504f)).ymm,
+        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    v = fmadd(n, Vector8(-0.693359375f), v);
+    v = fmadd(n, Vector8(2.12194440e-4f), v);
+
+    auto p = Vector8(1.9875691500e-4f);
+    p = fmadd(p, v, Vector8(1.3981999507e-3f));
+    p = fmadd(p, v, Vector8(8.3334519073e-3f));
+    p = fmadd(p, v, Vector8(4.1665795894e-2f));
+    p = fmadd(p, v, Vector8(1.6666665459e-1f));
+    p = fmadd(p, v, Vector8(5.0000001201e-1f));
+    p = fmadd(p, v * v, v + Vector8(1.0f));
+
+    // 2^n from the exponent bits, (n + 127) << 23 computed in float so that
+    // no AVX2 integer instructions are needed
+    auto bits = _mm256_cvtps_epi32(((n + Vector8(127.0f)) * Vector8(8388608.0f)).ymm);
+    return p * Vector8(_mm256_castsi256_ps(bits));
+}
+
+void blurVariance(Planes* planes, int32_t src, int32_t rowBegin, int32_t rowEnd)
+{
+    const auto& variance = planes->variance[src];
+    auto stride = (size_t)planes->stride;
+    for (int32_t y = rowBegin; y < rowEnd; ++y) {
+        for (int32_t x = 0; x < planes->width; x += 8) {
+            auto idx = planes->index(x, y);
+            auto sum = Vector8(0.0f);
+            auto weightSum = Vector8(0.0f);
+            for (int32_t dy = -1; dy <= 1; ++dy) {
+                for (int32_t dx = -1; dx <= 1; ++dx) {
+                    auto tap = idx + dy * stride + dx;
+                    auto w = Vector8((dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f))
+                        * load(planes->valid, tap);
+                    sum = fmadd(w, load(variance, tap), sum);
+                    weightSum += w;
+                }
+            }
+            // Lanes past the end of the row may see no valid pixel
+            store(planes->weightVariance, idx, sum / Vector8(_mm256_max_ps(
+                weightSum.ymm, _mm256_set1_ps(std::numeric_limits<float>::min()))));
+        }
+    }
+}
+
+void filterRows(Planes* planes, const DenoiseSettings& settings, int32_t src,
+    int32_t step, int32_t rowBegin, int32_t rowEnd)
+{
+    auto dst = 1 - src;
+    const auto& inR = planes->color[src][0];
+    const auto& inG = planes->color[src][1];
+    const auto& inB = planes->color[src][2];
+    const auto& inVariance = planes->variance[src];
+    auto stride = (ptrdiff_t)planes->stride;
+
+    auto invNormalSigma2 = Vector8(-1.0f / (settings.normalSigma * settings.normalSigma));
+    auto invAlbedoSigma2 = Vector8(-1.0f / (settings.albedoSigma * settings.albedoSigma));
+
+    for (int32_t y = rowBegin; y < rowEnd; ++y) {
+        for (int32_t x = 0; x < planes->width; x += 8) {
+            auto idx = planes->index(x, y);
+
+            auto r = load(inR, idx);
+            auto g = load(inG, idx);
+            auto b = load(inB, idx);
+            auto l = luminance(r, g, b);
+            Vector8 n[3];
+            Vector8 a[3];
+            for (int c = 0; c < 3; ++c) {
+                n[c] = load(planes->normal[c], idx);
+                a[c] = load(planes->albedo[c], idx);
+            }
+
+            auto deviation = Vector8(_mm256_sqrt_ps(_mm256_max_ps(
+                load(planes->weightVariance, idx).ymm, _mm256_setzero_ps())));
+            auto colorScale = Vector8(-1.0f)
+                / fmadd(Vector8(settings.colorSigma), deviation, Vector8(colorEpsilon));
+
+            auto weightSum = Vector8(0.0f);
+            auto sumR = Vector8(0.0f);
+            auto sumG = Vector8(0.0f);
+            auto sumB = Vector8(0.0f);
+            auto sumVariance = Vector8(0.0f);
+
+            for (int32_t j = 0; j < 5; ++j) {
+                for (int32_t i = 0; i < 5; ++i) {
+                    auto tap = (size_t)((ptrdiff_t)idx
+                        + ((j - 2) * stride + (i - 2)) * step);
+
+                    auto tapR = load(inR, tap);
+                    auto tapG = load(inG, tap);
+                    auto tapB = load(inB, tap);
+
+                    auto normalDistance = Vector8(0.0f);
+                    auto albedoDistance = Vector8(0.0f);
+                    for (int c = 0; c < 3; ++c) {
+                        auto dn = n[c] - load(planes->normal[c], tap);
+                        auto da = a[c] - load(planes->albedo[c], tap);
+                        normalDistance = fmadd(dn, dn, normalDistance);
+                        albedoDistance = fmadd(da, da, albedoDistance);
+                    }
+
+                    auto exponent = abs(l - luminance(tapR, tapG, tapB)) * colorScale;
+                    exponent = fmadd(normalDistance, invNormalSigma2, exponent);
+                    exponent = fmadd(albedoDistance, invAlbedoSigma2, exponent);
+
+                    auto w = Vector8(kernel[i] * kernel[j]) * load(planes->valid, tap)
+                        * fastExp(exponent);
+
+                    weightSum += w;
+                    sumR = fmadd(w, tapR, sumR);
+                    sumG = fmadd(w, tapG, sumG);
+                    sumB = fmadd(w, tapB, sumB);
+                    sumVariance = fmadd(w * w, load(inVariance, tap), sumVariance);
+                }
+            }
+
+            // The center tap always has a positive weight inside the image.
+            // Lanes past the end of the row land in the border, where they
+            // are only ever read with a zero weight.
+            auto invWeightSum = Vector8(1.0f) / Vector8(_mm256_max_ps(weightSum.ymm,
+                _mm256_set1_ps(std::numeric_limits<float>::min())));
+            store(planes->color[dst][0], idx, sumR * invWeightSum);
+            store(planes->color[dst][1], idx, sumG * invWeightSum);
+            store(planes->color[dst][2], idx, sumB * invWeightSum);
+            store(planes->variance[dst], idx, sumVariance * invWeightSum * invWeightSum);
+        }
+    }
+}
+
+// Runs a stage of one filter pass over a band of rows
+template <typename TStage>
+class RowTask : public Task {
+public:
+    RowTask(const TStage& stage, int32_t rowBegin, int32_t rowEnd)
+        : stage_(stage)
+        , rowBegin_(rowBegin)
+        , rowEnd_(rowEnd)
+    { }
+
+    void run() override
+    {
+        stage_(rowBegin_, rowEnd_);
+    }
+
+private:
+    TStage stage_;
+    int32_t rowBegin_;
+    int32_t rowEnd_;
+};
+
+template <typename TStage>
+void runRows(int32_t height, const TStage& stage)
+{
+    // A few bands per worker, so that the scheduler can balance them
+    auto bands = std::max(1, std::min(height, 4 * workerCount()));
+    WorkQueue tasks;
+    tasks.reserve(bands);
+    for (int32_t band = bands; band-- > 0;) {
+        tasks.push_back(std::make_unique<RowTask<TStage>>(stage,
+            band * height / bands, (band + 1) * height / bands));
+    }
+
+    enqueuTasks(tasks);
+    runTasks();
+    waitForCompletion();
+}
+
+} // anonymous namespace
+
+void denoise(const Sensor& sensor, const DenoiseSettings& settings,
+    std::vector<Spectrum>* image)
+{
+    auto iterations = std::max(1, std::min(settings.iterations, 10));
+
+    Planes planes;
+    planes.width = sensor.getWidth();
+    planes.height = sensor.getHeight();
+    planes.border = 2 << (iterations - 1);
+    // The last block of a row reads up to 7 pixels past the image
+    planes.stride = (planes.width + 2 * planes.border + 7 + 7) / 8 * 8;
+    planes.rows = planes.height + 2 * planes.border;
+
+    auto size = (size_t)planes.stride * planes.rows;
+    planes.valid.assign(size, 0.0f);
+    planes.weightVariance.assign(size, 0.0f);
+    for (int c = 0; c < 3; ++c) {
+        planes.normal[c].assign(size, 0.0f);
+        planes.albedo[c].assign(size, 0.0f);
+        planes.color[0][c].assign(size, 0.0f);
+        planes.color[1][c].assign(size, 0.0f);
+    }
+    planes.variance[0].assign(size, 0.0f);
+    planes.variance[1].assign(size, 0.0f);
+
+    for (int32_t y = 0; y < planes.height; ++y) {
+        for (int32_t x = 0; x < planes.width; ++x) {
+            auto idx = planes.index(x, y);
+            auto color = sensor.value(x, y).toRGB();
+            auto albedo = sensor.albedo(x, y).toRGB();
+            auto normal = sensor.normal(x, y);
+            planes.valid[idx] = 1.0f;
+            planes.color[0][0][idx] = color.r;
+            planes.color[0][1][idx] = color.g;
+            planes.color[0][2][idx] = color.b;
+            planes.albedo[0][idx] = albedo.r;
+            planes.albedo[1][idx] = albedo.g;
+            planes.albedo[2][idx] = albedo.b;
+            for (int c = 0; c < 3; ++c) {
+                planes.normal[c][idx] = normal[c];
+            }
+            planes.variance[0][idx] = std::min(sensor.meanVariance(x, y),
+                unknownVariance);
+        }
+    }
+
+    int32_t src = 0;
+    for (int32_t i = 0; i < iterations; ++i) {
+        runRows(planes.height, [&planes, src](int32_t begin, int32_t end) {
+            blurVariance(&planes, src, begin, end);
+        });
+        runRows(planes.height, [&planes, &settings, src, i](int32_t begin, int32_t end) {
+            filterRows(&planes, settings, src, 1 << i, begin, end);
+        });
+        src = 1 - src;
+    }
+
+    image->resize((size_t)planes.width * planes.height);
+    for (int32_t y = 0; y < planes.height; ++y) {
+        for (int32_t x = 0; x < planes.width; ++x) {
+            auto idx = planes.index(x, y);
+            (*image)[y * planes.width + x] = Spectrum(planes.color[src][0][idx],
+                planes.color[src][1][idx], planes.color[src][2][idx]);
+        }
+    }
+}
@@ -0,0 +1,366 @@
+#include "distributed.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "camera.h"
+#include "renderer.h"
+#include "timer.h"
+
+namespace {
+
+// Side of the image regions of the jobs, a few render tiles so that a job
+// keeps all threads of a worker busy
+constexpr int32_t jobTileSize = 64;
+// Seconds between heartbeats of a worker
+constexpr double heartbeatInterval = 1.0;
+
+enum MessageType : uint32_t {
+    // Coordinator to worker: the arguments of the render, each followed by a
+    // null character
+    ArgumentsMessage = 1,
+    // Coordinator to worker: a JobMessage
+    JobMessageType,
+    // Worker to coordinator: the job index and the SensorPixel array of the
+    // region, row major
+    ResultMessage,
+    // Worker to coordinator: still alive
+    HeartbeatMessage,
+    // Coordinator to worker: no more jobs
+    DoneMessage,
+};
+
+struct JobMessage {
+    uint32_t job;
+    int32_t startX;
+    int32_t startY;
+    int32_t endX;
+    int32_t endY;
+    int32_t sampleBegin;
+    int32_t sampleEnd;
+};
+
+// Pixels are sent as they are in memory
+static_assert(sizeof(SensorPixel) == 11 * sizeof(float), "SensorPixel has padding");
+
+int64_t regionPixels(const Tile& region)
+{
+    return (int64_t)(region.end.x - region.start.x)
+        * (region.end.y - region.start.y);
+}
+
+} // anonymous namespace
+
+Coordinator::Coordinator(const std::vector<std::string>& arguments,
+    double workerTimeout)
+    : arguments_(arguments)
+    , workerTimeout_(workerTimeout)
+    , camera_(nullptr)
+    , tileCount_(0)
+    , jobsDone_(0)
+{ }
+
+bool Coordinator::listen(const std::string& address)
+{
+    return listener_.listen(address);
+}
+
+void Coordinator::render(const RenderSettings& settings, Camera& camera)
+{
+    using Seconds = std::chrono::duration<double>;
+
+    camera_ = &camera;
+    stats_ = DistributedStats();
+    jobs_.clear();
+    jobsDone_ = 0;
+    connections_.clear();
+
+    // Every tile of a pass before the next pass, so that the image fills in
+    // evenly
+    auto spp = std::max(1, settings.samplesPerPixel);
+    auto passSamples = std::max(1, std::min(spp, settings.samplesPerPass));
+    auto tiles = makeTiles(camera.getResolution(), jobTileSize,
+        TileOrder::Hilbert, std::vector<float>());
+    for (auto begin = 0; begin < spp; begin += passSamples) {
+        auto end = std::min(spp, begin + passSamples);
+        for (const auto& tile : tiles) {
+            jobs_.push_back({ tile, begin, end, 0, false });
+        }
+    }
+    tileCount_ = tiles.size();
+    stats_.jobs = (int64_t)jobs_.size();
+
+    auto start = Timer::Clock::now();
+    std::vector<std::thread> threads;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (jobsDone_ == (int64_t)jobs_.size())
+                break;
+        }
+
+        Socket client;
+        if (listener_.accept(&client, 0.1)) {
+            auto worker = stats_.workers++;
+            printf("Worker %d connected\n", worker);
+            threads.emplace_back(&Coordinator::serveWorker, this,
+                std::move(client), worker);
+        }
+    }
+
+    // Backup copies of the last jobs may still be running
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    stats_.seconds = Seconds(Timer::Clock::now() - start).count();
+    camera_ = nullptr;
+}
+
+void Coordinator::serveWorker(Socket socket, int32_t worker)
+{
+    socket.setReceiveTimeout(workerTimeout_);
+
+    std::vector<char> arguments;
+    for (const auto& argument : arguments_) {
+        arguments.insert(arguments.end(), argument.begin(), argument.end());
+        arguments.push_back('\0');
+    }
+
+    if (!sendMessage(socket, ArgumentsMessage, arguments.data(),
+        arguments.size())) {
+        printf("Worker %d lost before its first job\n", worker);
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connections_[worker] = { &socket, -1 };
+    }
+
+    std::vector<char> payload;
+    for (;;) {
+        auto index = claimJob(worker);
+        if (index < 0) {
+            sendMessage(socket, DoneMessage, nullptr, 0);
+            return;
+        }
+
+        const auto& job = jobs_[index];
+        JobMessage message = { (uint32_t)index, job.region.start.x,
+            job.region.start.y, job.region.end.x, job.region.end.y,
+            job.sampleBegin, job.sampleEnd };
+        bool completed = false;
+        if (sendMessage(socket, JobMessageType, &message, sizeof(message))) {
+            uint32_t type;
+            while (receiveMessage(socket, &type, &payload)) {
+                if (type == HeartbeatMessage)
+                    continue;
+
+                auto expectedSize = sizeof(uint32_t)
+                    + regionPixels(job.region) * sizeof(SensorPixel);
+                uint32_t resultJob = 0;
+                if (payload.size() >= sizeof(uint32_t))
+                    std::memcpy(&resultJob, payload.data(), sizeof(uint32_t));
+                completed = type == ResultMessage
+                    && payload.size() == expectedSize
+                    && resultJob == (uint32_t)index;
+                break;
+            }
+        }
+
+        if (!completed) {
+            if (releaseJob(worker)) {
+                printf("Worker %d lost, its job goes back to the queue\n",
+                    worker);
+            } else {
+                printf("Worker %d dropped, another worker did its job\n",
+                    worker);
+            }
+            return;
+        }
+
+        completeJob(worker, payload);
+    }
+}
+
+int32_t Coordinator::claimJob(int32_t worker)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto& connection = connections_[worker];
+    for (;;) {
+        if (jobsDone_ == (int64_t)jobs_.size())
+            return -1;
+
+        // A region gets its passes in order, so that the sensor sums them
+        // in the order a single process would
+        bool queued = false;
+        for (size_t i = 0; i < jobs_.size(); ++i) {
+            if (jobs_[i].done || jobs_[i].running != 0)
+                continue;
+
+            if (i < tileCount_ || jobs_[i - tileCount_].done) {
+                jobs_[i].running = 1;
+                connection.job = (int32_t)i;
+                return (int32_t)i;
+            }
+            queued = true;
+        }
+
+        // Jobs waiting for their previous pass start once it is done, back
+        // up running jobs only when the queue is empty
+        if (queued) {
+            condition_.wait(lock);
+            continue;
+        }
+
+        // Back up the oldest job with a single worker
+        for (size_t i = 0; i < jobs_.size(); ++i) {
+            if (!jobs_[i].done && jobs_[i].running == 1) {
+                jobs_[i].running = 2;
+                stats_.backupJobs += 1;
+                connection.job = (int32_t)i;
+                return (int32_t)i;
+            }
+        }
+
+        condition_.wait(lock);
+    }
+}
+
+bool Coordinator::releaseJob(int32_t worker)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto& connection = connections_[worker];
+    auto& job = jobs_[connection.job];
+    connection.job = -1;
+    job.running -= 1;
+    auto lost = !job.done;
+    if (lost)
+        stats_.lostJobs += 1;
+    condition_.notify_all();
+    return lost;
+}
+
+void Coordinator::completeJob(int32_t worker, const std::vector<char>& payload)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto& connection = connections_[worker];
+    auto& job = jobs_[connection.job];
+    connection.job = -1;
+    job.running -= 1;
+    if (!job.done) {
+        job.done = true;
+        jobsDone_ += 1;
+
+        auto& sensor = camera_->getSensor();
+        auto* pixels = payload.data() + sizeof(uint32_t);
+        for (int32_t y = job.region.start.y; y < job.region.end.y; ++y) {
+            for (int32_t x = job.region.start.x; x < job.region.end.x; ++x) {
+                SensorPixel pixel;
+                std::memcpy(&pixel, pixels, sizeof(pixel));
+                pixels += sizeof(pixel);
+                sensor.addPixel(x, y, pixel);
+            }
+        }
+
+        // Workers still holding a job hold a backup copy of a done job, a
+        // stalled one would keep the frame open until it timed out
+        if (jobsDone_ == (int64_t)jobs_.size()) {
+            for (auto& other : connections_) {
+                if (other.second.job >= 0)
+                    other.second.socket->shutdown();
+            }
+        }
+    }
+    condition_.notify_all();
+}
+
+bool DistributedWorker::connect(const std::string& address,
+    std::vector<std::string>* arguments)
+{
+    if (!socket_.connect(address))
+        return false;
+
+    uint32_t type;
+    std::vector<char> payload;
+    if (!receiveMessage(socket_, &type, &payload) || type != ArgumentsMessage) {
+        printf("No render arguments from %s\n", address.c_str());
+        return false;
+    }
+
+    arguments->clear();
+    for (auto begin = payload.begin(); begin != payload.end();) {
+        auto end = std::find(begin, payload.end(), '\0');
+        arguments->emplace_back(begin, end);
+        begin = end == payload.end() ? end : end + 1;
+    }
+    return true;
+}
+
+bool DistributedWorker::serve(Renderer& renderer, const Scene& scene,
+    Camera& camera)
+{
+    // Heartbeats and results share the socket
+    std::mutex sendMutex;
+    std::condition_variable stopCondition;
+    bool stop = false;
+
+    std::thread heartbeat([&]() {
+        std::unique_lock<std::mutex> lock(sendMutex);
+        while (!stop) {
+            stopCondition.wait_for(lock,
+                std::chrono::duration<double>(heartbeatInterval));
+            if (!stop)
+                sendMessage(socket_, HeartbeatMessage, nullptr, 0);
+        }
+    });
+
+    auto& sensor = camera.getSensor();
+    bool success = false;
+    uint32_t type;
+    std::vector<char> payload;
+    std::vector<char> result;
+    while (receiveMessage(socket_, &type, &payload)) {
+        if (type == DoneMessage) {
+            success = true;
+            break;
+        }
+
+        JobMessage job;
+        if (type != JobMessageType || payload.size() != sizeof(job))
+            break;
+        std::memcpy(&job, payload.data(), sizeof(job));
+
+        Tile region(Vector2i(job.startX, job.startY),
+            Vector2i(job.endX, job.endY), Vector2i(0, 0));
+        renderer.renderRegion(scene, camera, region, job.sampleBegin,
+            job.sampleEnd);
+
+        result.resize(sizeof(uint32_t) + regionPixels(region) * sizeof(SensorPixel));
+        std::memcpy(result.data(), &job.job, sizeof(uint32_t));
+        auto* pixels = result.data() + sizeof(uint32_t);
+        for (int32_t y = region.start.y; y < region.end.y; ++y) {
+            for (int32_t x = region.start.x; x < region.end.x; ++x) {
+                auto pixel = sensor.takePixel(x, y);
+                std::memcpy(pixels, &pixel, sizeof(pixel));
+                pixels += sizeof(pixel);
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(sendMutex);
+        if (!sendMessage(socket_, ResultMessage, result.data(), result.size()))
+            break;
+        jobs_ += 1;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(sendMutex);
+        stop = true;
+    }
+    stopCondition.notify_all();
+    heartbeat.join();
+    return success;
+}
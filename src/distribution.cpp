@@ -0,0 +1,56 @@
+#include "distribution.h"
+
+void AliasTable::build(const std::vector<float>& weights)
+{
+    auto n = weights.size();
+    bins_.resize(n);
+    pmf_.resize(n);
+    if (n == 0)
+        return;
+
+    double total = 0.0;
+    for (auto w : weights) {
+        total += std::max(0.0f, w);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        pmf_[i] = total > 0.0
+            ? (float)(std::max(0.0f, weights[i]) / total) : 1.0f / n;
+    }
+
+    // Split the bins into those below and above the average weight, then
+    // fill every small bin with the excess of a large one
+    std::vector<double> scaled(n);
+    std::vector<int32_t> small;
+    std::vector<int32_t> large;
+    for (size_t i = 0; i < n; ++i) {
+        scaled[i] = (double)pmf_[i] * n;
+        if (scaled[i] < 1.0)
+            small.push_back((int32_t)i);
+        else
+            large.push_back((int32_t)i);
+    }
+
+    while (!small.empty() && !large.empty()) {
+        auto s = small.back();
+        small.pop_back();
+        auto l = large.back();
+
+        bins_[s].probability = (float)scaled[s];
+        bins_[s].alias = l;
+
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    // Leftovers are off from 1 only by rounding
+    for (auto i : large) {
+        bins_[i] = { 1.0f, i };
+    }
+    for (auto i : small) {
+        bins_[i] = { 1.0f, i };
+    }
+}
@@ -0,0 +1,396 @@
+#include "guiding.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include "constants.h"
+#include "scheduler.h"
+
+namespace {
+
+// Samples a cell needs in the first iteration to be split, grows with the
+// square root of the iteration length as in the paper
+constexpr float spatialThreshold = 12000.0f;
+// Directional quadrants holding more than this fraction of the energy are
+// subdivided
+constexpr float subdivideFraction = 0.01f;
+constexpr int32_t maxDirectionalDepth = 20;
+// Cells refined by a single task
+constexpr size_t cellsPerTask = 64;
+
+void atomicAdd(std::atomic<float>* target, float value)
+{
+    auto current = target->load(std::memory_order_relaxed);
+    while (!target->compare_exchange_weak(current, current + value,
+        std::memory_order_relaxed)) { }
+}
+
+// Position of a direction on the unit square
+Vector2f directionToSquare(const Vector3f& direction)
+{
+    float cosTheta = std::min(std::max(direction.z, -1.0f), 1.0f);
+    float phi = std::atan2(direction.y, direction.x);
+    if (phi < 0.0f)
+        phi += 2.0f * PI;
+    return Vector2f(
+        std::min(0.5f * (cosTheta + 1.0f), 0.99999994f),
+        std::min(phi * INV_2PI, 0.99999994f));
+}
+
+Vector3f squareToDirection(const Vector2f& p)
+{
+    float cosTheta = 2.0f * p.x - 1.0f;
+    float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    float phi = 2.0f * PI * p.y;
+    return Vector3f(sinTheta * std::cos(phi), sinTheta * std::sin(phi),
+        cosTheta);
+}
+
+// Quadrant of a point of the unit square, moves the point into the
+// quadrant's own unit square
+int32_t descend(Vector2f* p)
+{
+    int32_t qx = p->x >= 0.5f ? 1 : 0;
+    int32_t qy = p->y >= 0.5f ? 1 : 0;
+    p->x = 2.0f * p->x - qx;
+    p->y = 2.0f * p->y - qy;
+    return qx + 2 * qy;
+}
+
+// Picks the second half with probability second / (first + second), even
+// odds if both are empty. Rescales u to [0, 1) within the chosen half.
+int32_t pickHalf(float first, float second, float* u)
+{
+    float total = first + second;
+    float pFirst = total > 0.0f ? first / total : 0.5f;
+    if (*u < pFirst) {
+        *u = *u / pFirst;
+        return 0;
+    }
+    *u = std::min((*u - pFirst) / (1.0f - pFirst), 0.99999994f);
+    return 1;
+}
+
+// Refines the cells [begin, end) of a training iteration
+template <typename TCell>
+class RefineTask : public Task {
+public:
+    RefineTask(TCell* cells, size_t begin, size_t end)
+        : cells_(cells)
+        , begin_(begin)
+        , end_(end)
+    { }
+
+    void run() override
+    {
+        for (auto i = begin_; i < end_; ++i) {
+            auto& cell = cells_[i];
+            // Cells nothing passed through keep their previous estimate
+            cell.building.sumEnergy();
+            if (cell.building.total() > 0.0f) {
+                cell.sampling = cell.building;
+                cell.building = cell.building.refined(subdivideFraction,
+                    maxDirectionalDepth);
+            }
+            cell.samples.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    TCell* cells_;
+    size_t begin_;
+    size_t end_;
+};
+
+} // anonymous namespace
+
+DirectionalTree::Node::Node()
+{
+    for (int32_t q = 0; q < 4; ++q) {
+        child[q] = 0;
+        energy[q].store(0.0f, std::memory_order_relaxed);
+    }
+}
+
+DirectionalTree::Node::Node(const Node& copy)
+{
+    *this = copy;
+}
+
+DirectionalTree::Node& DirectionalTree::Node::operator=(const Node& copy)
+{
+    for (int32_t q = 0; q < 4; ++q) {
+        child[q] = copy.child[q];
+        energy[q].store(copy.energy[q].load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+    }
+    return *this;
+}
+
+DirectionalTree::DirectionalTree()
+    : nodes_(1)
+{ }
+
+void DirectionalTree::record(const Vector3f& direction, float value)
+{
+    auto p = directionToSquare(direction);
+    uint32_t index = 0;
+    for (;;) {
+        auto& node = nodes_[index];
+        auto q = descend(&p);
+        if (node.child[q] == 0) {
+            atomicAdd(&node.energy[q], value);
+            break;
+        }
+        index = node.child[q];
+    }
+}
+
+void DirectionalTree::sumEnergy()
+{
+    // Children are created after their parents, a backwards sweep sees every
+    // child before its parent
+    for (auto i = nodes_.size(); i-- > 0;) {
+        auto& node = nodes_[i];
+        for (int32_t q = 0; q < 4; ++q) {
+            if (node.child[q] == 0)
+                continue;
+            const auto& child = nodes_[node.child[q]];
+            float energy = 0.0f;
+            for (const auto& quarter : child.energy) {
+                energy += quarter.load(std::memory_order_relaxed);
+            }
+            node.energy[q].store(energy, std::memory_order_relaxed);
+        }
+    }
+}
+
+Vector3f DirectionalTree::sample(float u1, float u2) const
+{
+    Vector2f origin(0.0f, 0.0f);
+    float size = 1.0f;
+    uint32_t index = 0;
+    for (;;) {
+        const auto& node = nodes_[index];
+        float e[4];
+        for (int32_t q = 0; q < 4; ++q) {
+            e[q] = node.energy[q].load(std::memory_order_relaxed);
+        }
+
+        auto qx = pickHalf(e[0] + e[2], e[1] + e[3], &u1);
+        auto qy = pickHalf(e[qx], e[qx + 2], &u2);
+        size *= 0.5f;
+        origin.x += qx * size;
+        origin.y += qy * size;
+
+        auto child = node.child[qx + 2 * qy];
+        if (child == 0)
+            break;
+        index = child;
+    }
+
+    return squareToDirection(Vector2f(origin.x + u1 * size,
+        origin.y + u2 * size));
+}
+
+float DirectionalTree::pdf(const Vector3f& direction) const
+{
+    auto p = directionToSquare(direction);
+    float pdf = 1.0f;
+    uint32_t index = 0;
+    for (;;) {
+        const auto& node = nodes_[index];
+        float total = 0.0f;
+        for (int32_t q = 0; q < 4; ++q) {
+            total += node.energy[q].load(std::memory_order_relaxed);
+        }
+
+        auto q = descend(&p);
+        // Empty nodes are sampled uniformly
+        if (total > 0.0f)
+            pdf *= 4.0f * node.energy[q].load(std::memory_order_relaxed) / total;
+        if (node.child[q] == 0 || pdf == 0.0f)
+            break;
+        index = node.child[q];
+    }
+    return pdf / (4.0f * PI);
+}
+
+float DirectionalTree::total() const
+{
+    const auto& root = nodes_[0];
+    float total = 0.0f;
+    for (int32_t q = 0; q < 4; ++q) {
+        total += root.energy[q].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+DirectionalTree DirectionalTree::refined(float subdivideFraction,
+    int32_t maxDepth) const
+{
+    DirectionalTree tree;
+    tree.refineNode(*this, 0, 0, subdivideFraction * total(), 1, maxDepth);
+    return tree;
+}
+
+void DirectionalTree::refineNode(const DirectionalTree& source,
+    uint32_t sourceIndex, uint32_t index, float threshold, int32_t depth,
+    int32_t maxDepth)
+{
+    const auto& sourceNode = source.nodes_[sourceIndex];
+    for (int32_t q = 0; q < 4; ++q) {
+        float energy = sourceNode.energy[q].load(std::memory_order_relaxed);
+        if (depth >= maxDepth || energy <= threshold)
+            continue;
+
+        auto child = (uint32_t)nodes_.size();
+        nodes_.emplace_back();
+        nodes_[index].child[q] = child;
+
+        // A source leaf is split into four quadrants of a quarter of its
+        // energy each
+        auto sourceChild = sourceNode.child[q];
+        if (sourceChild != 0) {
+            refineNode(source, sourceChild, child, threshold, depth + 1,
+                maxDepth);
+        } else if (energy * 0.25f > threshold && depth + 1 < maxDepth) {
+            DirectionalTree leaf;
+            for (auto& quarter : leaf.nodes_[0].energy) {
+                quarter.store(energy * 0.25f, std::memory_order_relaxed);
+            }
+            refineNode(leaf, 0, child, threshold, depth + 1, maxDepth);
+        }
+    }
+}
+
+GuidingTree::Cell::Cell(const Cell& copy)
+    : sampling(copy.sampling)
+    , building(copy.building)
+    , samples(copy.samples.load(std::memory_order_relaxed))
+{ }
+
+GuidingTree::GuidingTree(const BBox& bounds, size_t maxBytes)
+    : bounds_(bounds)
+    , maxBytes_(maxBytes)
+    , training_(true)
+{
+    nodes_.push_back({ { 0, 0 }, true });
+    cells_.emplace_back();
+}
+
+uint32_t GuidingTree::cell(const Vector3f& position) const
+{
+    float min[3] = { bounds_.min.x, bounds_.min.y, bounds_.min.z };
+    float max[3] = { bounds_.max.x, bounds_.max.y, bounds_.max.z };
+    uint32_t index = 0;
+    for (int32_t axis = 0; !nodes_[index].isLeaf; axis = (axis + 1) % 3) {
+        float middle = 0.5f * (min[axis] + max[axis]);
+        if (position[axis] < middle) {
+            max[axis] = middle;
+            index = nodes_[index].child[0];
+        } else {
+            min[axis] = middle;
+            index = nodes_[index].child[1];
+        }
+    }
+    return nodes_[index].child[0];
+}
+
+void GuidingTree::record(uint32_t cell, const Vector3f& direction,
+    const Spectrum& gathered, const Spectrum& weight, float pdf)
+{
+    if (pdf <= 0.0f)
+        return;
+
+    auto value = gathered.toRGB();
+    auto w = weight.toRGB();
+    auto radiance = Spectrum(
+        w.r > 0.0f ? value.r / w.r : 0.0f,
+        w.g > 0.0f ? value.g / w.g : 0.0f,
+        w.b > 0.0f ? value.b / w.b : 0.0f);
+
+    // Radiance over the pdf of the direction, so the recorded energy
+    // estimates the incident radiance no matter how the direction was found
+    auto energy = radiance.y() / pdf;
+    if (!(energy >= 0.0f) || std::isinf(energy))
+        return;
+
+    auto& target = cells_[cell];
+    target.building.record(direction, energy);
+    target.samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+void GuidingTree::refine(int32_t iteration)
+{
+    splitCells(iteration);
+
+    WorkQueue tasks;
+    for (size_t begin = 0; begin < cells_.size(); begin += cellsPerTask) {
+        auto end = std::min(cells_.size(), begin + cellsPerTask);
+        tasks.push_back(std::make_unique<RefineTask<Cell>>(cells_.data(),
+            begin, end));
+    }
+
+    enqueuTasks(tasks);
+    runTasks();
+    waitForCompletion();
+}
+
+void GuidingTree::splitCells(int32_t iteration)
+{
+    auto threshold = (uint32_t)(spatialThreshold
+        * std::sqrt(std::pow(2.0f, (float)iteration)));
+
+    auto totalBytes = bytes();
+    // Children of a split are checked again, a cell may be split several
+    // times in a single iteration
+    std::vector<uint32_t> stack;
+    for (uint32_t i = 0; i < nodes_.size(); ++i) {
+        if (nodes_[i].isLeaf)
+            stack.push_back(i);
+    }
+
+    while (!stack.empty()) {
+        auto index = stack.back();
+        stack.pop_back();
+
+        auto cellIndex = nodes_[index].child[0];
+        auto samples = cells_[cellIndex].samples.load(std::memory_order_relaxed);
+        if (samples <= threshold)
+            continue;
+
+        // The new cell copies the trees of the old one
+        const auto& cell = cells_[cellIndex];
+        auto cellBytes = sizeof(Cell) + cell.sampling.bytes()
+            + cell.building.bytes();
+        auto splitBytes = cellBytes + 2 * sizeof(SpatialNode);
+        if (totalBytes + splitBytes > maxBytes_)
+            continue;
+        totalBytes += splitBytes;
+
+        auto first = (uint32_t)nodes_.size();
+        auto newCell = (uint32_t)cells_.size();
+        cells_.push_back(cells_[cellIndex]);
+        cells_[cellIndex].samples.store(samples / 2, std::memory_order_relaxed);
+        cells_[newCell].samples.store(samples / 2, std::memory_order_relaxed);
+
+        nodes_.push_back({ { cellIndex, 0 }, true });
+        nodes_.push_back({ { newCell, 0 }, true });
+        nodes_[index] = { { first, first + 1 }, false };
+
+        stack.push_back(first);
+        stack.push_back(first + 1);
+    }
+}
+
+size_t GuidingTree::bytes() const
+{
+    size_t total = nodes_.size() * sizeof(SpatialNode);
+    for (const auto& cell : cells_) {
+        total += sizeof(Cell) + cell.sampling.bytes()
+            + cell.building.bytes();
+    }
+    return total;
+}
@@ -0,0 +1,73 @@
+#include "imagewriter.h"
+
+#include <cstdio>
+#include <utility>
+
+ImageWriter::ImageWriter(size_t maxPending)
+    : maxPending_(maxPending > 0 ? maxPending : 1)
+    , writing_(false)
+    , failed_(false)
+    , shuttingDown_(false)
+{
+    thread_ = std::thread([this]() { run(); });
+}
+
+ImageWriter::~ImageWriter()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        shuttingDown_ = true;
+    }
+    condition_.notify_all();
+    thread_.join();
+}
+
+void ImageWriter::submit(const std::string& name, Bitmap bitmap,
+    bool toneMapped)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (pending_.size() >= maxPending_) {
+            condition_.wait(lock);
+        }
+        pending_.push_back({ name, std::move(bitmap), toneMapped });
+    }
+    condition_.notify_all();
+}
+
+bool ImageWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!pending_.empty() || writing_) {
+        condition_.wait(lock);
+    }
+    return !failed_;
+}
+
+void ImageWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        while (pending_.empty() && !shuttingDown_) {
+            condition_.wait(lock);
+        }
+        if (pending_.empty())
+            return;
+
+        auto image = std::move(pending_.front());
+        pending_.pop_front();
+        writing_ = true;
+        // A slot in the queue is free
+        condition_.notify_all();
+        lock.unlock();
+
+        auto success = image.bitmap.write(image.name, image.toneMapped);
+        if (!success)
+            printf("Can't write %s\n", image.name.c_str());
+
+        lock.lock();
+        writing_ = false;
+        failed_ = failed_ || !success;
+        condition_.notify_all();
+    }
+}
@@ -0,0 +1,36 @@
+#include "integrator.h"
+
+#include <cstring>
+
+const char* integratorName(IntegratorType type)
+{
+    switch (type) {
+    case IntegratorType::PathTracer:        return "path";
+    case IntegratorType::DirectLighting:    return "direct";
+    case IntegratorType::AmbientOcclusion:  return "ao";
+    case IntegratorType::Normals:           return "normals";
+    case IntegratorType::Headlight:         return "headlight";
+    case IntegratorType::Wavefront:         return "wavefront";
+    }
+    return "unknown";
+}
+
+bool parseIntegrator(const char* name, IntegratorType* type)
+{
+    static const IntegratorType types[] = {
+        IntegratorType::PathTracer,
+        IntegratorType::DirectLighting,
+        IntegratorType::AmbientOcclusion,
+        IntegratorType::Normals,
+        IntegratorType::Headlight,
+        IntegratorType::Wavefront,
+    };
+
+    for (auto candidate : types) {
+        if (std::strcmp(name, integratorName(candidate)) == 0) {
+            *type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,96 @@
+#include "interactive.h"
+
+#include "camera.h"
+#include "scene.h"
+
+InteractiveSession::InteractiveSession(const Scene& scene, Camera& camera,
+    const RenderSettings& settings, TileOrder tileOrder)
+    : scene_(scene)
+    , camera_(camera)
+    , position_(camera.getPosition())
+    , direction_(camera.getDirection())
+    , view_(0)
+    , appliedView_(0)
+    , stopping_(false)
+    , cancel_(false)
+{
+    renderer_.setSettings(settings);
+    renderer_.setTileOrder(tileOrder);
+    renderer_.setCancelFlag(&cancel_);
+}
+
+InteractiveSession::~InteractiveSession()
+{
+    stop();
+}
+
+void InteractiveSession::start(FrameCallback callback, ViewCallback viewDone)
+{
+    callback_ = callback;
+    viewDone_ = viewDone;
+    stopping_ = false;
+    thread_ = std::thread(&InteractiveSession::run, this);
+}
+
+void InteractiveSession::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopping_ = true;
+        cancel_ = true;
+    }
+    condition_.notify_all();
+
+    if (thread_.joinable())
+        thread_.join();
+}
+
+uint64_t InteractiveSession::setView(const Vector3f& position,
+    const Vector3f& direction)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    position_ = position;
+    direction_ = direction;
+    view_ += 1;
+    cancel_ = true;
+    condition_.notify_all();
+    return view_;
+}
+
+void InteractiveSession::run()
+{
+    // The current view has all its samples
+    bool converged = false;
+    for (;;) {
+        uint64_t view;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this, converged]() {
+                return stopping_ || view_ != appliedView_ || !converged;
+            });
+            if (stopping_)
+                return;
+
+            // Only the latest of several moves is rendered
+            if (view_ != appliedView_) {
+                camera_.setView(position_, direction_);
+                camera_.getSensor().clear();
+                appliedView_ = view_;
+                cancel_ = false;
+            }
+            view = appliedView_;
+        }
+
+        renderer_.setPassCallback([this, view](const RenderStats& stats,
+            Camera& camera) {
+            callback_(stats, camera, view);
+            return true;
+        });
+        renderer_.render(scene_, camera_);
+
+        // A cancelled render is picked up again with the new view
+        converged = !cancel_.load();
+        if (converged && viewDone_)
+            viewDone_(view);
+    }
+}
@@ -0,0 +1,388 @@
+#include "lightbvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "bbox.h"
+#include "constants.h"
+
+// methods internal to the file
+namespace {
+
+const int32_t bucketCount = 12;
+// Below this depth splits minimize the cost estimate, deeper ones halve the
+// light list, so that the bit trails never run out of bits
+const int32_t maxCostSplitDepth = 40;
+
+float safeSqrt(float v)
+{
+    return std::sqrt(std::max(0.0f, v));
+}
+
+float safeAcos(float v)
+{
+    return std::acos(std::min(1.0f, std::max(-1.0f, v)));
+}
+
+Vector3f centroid(const BBox& box)
+{
+    return (box.min + box.max) * 0.5f;
+}
+
+Vector3f diagonal(const BBox& box)
+{
+    return box.max - box.min;
+}
+
+float surfaceArea(const BBox& box)
+{
+    auto d = diagonal(box);
+    return 2.0f * (d.x * d.y + d.x * d.z + d.y * d.z);
+}
+
+// Rotates v around the unit axis by angle (Rodrigues' formula)
+Vector3f rotate(const Vector3f& v, const Vector3f& axis, float angle)
+{
+    float cosAngle = std::cos(angle);
+    float sinAngle = std::sin(angle);
+    return v * cosAngle + cross(axis, v) * sinAngle
+        + axis * (dot(axis, v) * (1.0f - cosAngle));
+}
+
+// Smallest cone (axis w, cosine of the half angle) containing both cones
+void coneUnion(const Vector3f& wa, float cosA, const Vector3f& wb, float cosB,
+    Vector3f* w, float* cosTheta)
+{
+    float thetaA = safeAcos(cosA);
+    float thetaB = safeAcos(cosB);
+    float thetaD = safeAcos(dot(wa, wb));
+
+    if (std::min(thetaD + thetaB, PI) <= thetaA) {
+        *w = wa;
+        *cosTheta = cosA;
+        return;
+    }
+    if (std::min(thetaD + thetaA, PI) <= thetaB) {
+        *w = wb;
+        *cosTheta = cosB;
+        return;
+    }
+
+    float thetaO = (thetaA + thetaD + thetaB) * 0.5f;
+    auto axis = cross(wa, wb);
+    if (thetaO >= PI || length2(axis) == 0.0f) {
+        *w = wa;
+        *cosTheta = -1.0f;
+        return;
+    }
+
+    *w = normal(rotate(wa, normal(axis), thetaO - thetaA));
+    *cosTheta = std::cos(thetaO);
+}
+
+LightBounds boundsUnion(const LightBounds& a, const LightBounds& b)
+{
+    if (a.phi == 0.0f)
+        return b;
+    if (b.phi == 0.0f)
+        return a;
+
+    LightBounds result;
+    coneUnion(a.w, a.cosThetaO, b.w, b.cosThetaO, &result.w, &result.cosThetaO);
+    result.cosThetaE = std::min(a.cosThetaE, b.cosThetaE);
+    result.bounds = boxUnion(a.bounds, b.bounds);
+    result.phi = a.phi + b.phi;
+    result.twoSided = a.twoSided || b.twoSided;
+    return result;
+}
+
+// Cosine of the half angle of the cone around the direction to the box centre
+// containing the box, as seen from the point
+float boundSubtendedCosTheta(const BBox& box, const Vector3f& p)
+{
+    auto center = centroid(box);
+    float radius2 = length2(diagonal(box)) * 0.25f;
+    float distance2 = length2(p - center);
+    if (distance2 <= radius2)
+        return -1.0f;
+
+    return safeSqrt(1.0f - radius2 / distance2);
+}
+
+// cos(max(0, a - b)) of angles given by their sines and cosines
+float cosSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+    if (cosA > cosB)
+        return 1.0f;
+    return cosA * cosB + sinA * sinB;
+}
+
+// sin(max(0, a - b))
+float sinSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+    if (cosA > cosB)
+        return 0.0f;
+    return sinA * cosB - cosA * sinB;
+}
+
+// Conservative estimate of the light arriving at the point from the lights
+// inside the bounds. Zero if no light inside can reach it.
+float importance(const LightBounds& lb, const Vector3f& p, const Vector3f& n)
+{
+    if (lb.phi == 0.0f)
+        return 0.0f;
+
+    auto center = centroid(lb.bounds);
+    float distance2 = std::max(length2(p - center),
+        length(diagonal(lb.bounds)) * 0.5f);
+
+    // Angle between the emission axis and the direction to the point, minus
+    // the spread of the emission cone and of the bounds as seen from the point
+    auto wi = p - center;
+    float wiLength = length(wi);
+    wi = wiLength > 0.0f ? wi / wiLength : lb.w;
+
+    float cosThetaW = dot(lb.w, wi);
+    if (lb.twoSided)
+        cosThetaW = std::abs(cosThetaW);
+    float sinThetaW = safeSqrt(1.0f - cosThetaW * cosThetaW);
+
+    float cosThetaB = boundSubtendedCosTheta(lb.bounds, p);
+    float sinThetaB = safeSqrt(1.0f - cosThetaB * cosThetaB);
+
+    float sinThetaO = safeSqrt(1.0f - lb.cosThetaO * lb.cosThetaO);
+    float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, lb.cosThetaO);
+    float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, lb.cosThetaO);
+    float cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= lb.cosThetaE)
+        return 0.0f;
+
+    float result = lb.phi * cosThetaP / distance2;
+
+    // Lights below the surface don't contribute
+    if (n.x != 0.0f || n.y != 0.0f || n.z != 0.0f) {
+        float cosThetaI = -dot(wi, n);
+        float sinThetaI = safeSqrt(1.0f - cosThetaI * cosThetaI);
+        result *= cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+    }
+
+    return std::max(result, 0.0f);
+}
+
+// Cost of a node, prefers nodes with small surface area, narrow emission
+// cones and low power
+float splitCost(const LightBounds& lb, const BBox& parentBounds, int32_t dim)
+{
+    float thetaO = safeAcos(lb.cosThetaO);
+    float thetaE = safeAcos(lb.cosThetaE);
+    float thetaW = std::min(thetaO + thetaE, PI);
+    float sinThetaO = safeSqrt(1.0f - lb.cosThetaO * lb.cosThetaO);
+    float mOmega = 2.0f * PI * (1.0f - lb.cosThetaO)
+        + PI / 2.0f * (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW)
+            - 2.0f * thetaO * sinThetaO + lb.cosThetaO);
+
+    // Penalize thin slabs along the split axis
+    auto d = diagonal(parentBounds);
+    float kr = d[dim] > 0.0f
+        ? std::max(d.x, std::max(d.y, d.z)) / d[dim] : 0.0f;
+
+    return lb.phi * mOmega * kr * surfaceArea(lb.bounds);
+}
+
+} // anonymous namespace
+
+void LightBvh::build(const std::vector<std::shared_ptr<Light>>& lights)
+{
+    nodes_.clear();
+    bitTrails_.assign(lights.size(), 0);
+    inTree_.assign(lights.size(), 0);
+
+    std::vector<BuildLight> buildLights;
+    for (size_t i = 0; i < lights.size(); ++i) {
+        auto lb = lights[i]->lightBounds();
+        if (lb.phi > 0.0f)
+            buildLights.push_back({ (int32_t)i, lb });
+    }
+
+    if (buildLights.empty())
+        return;
+
+    nodes_.reserve(2 * buildLights.size() - 1);
+    buildRecursive(buildLights, 0, buildLights.size(), 0, 0);
+}
+
+int32_t LightBvh::buildRecursive(std::vector<BuildLight>& lights, size_t begin,
+    size_t end, uint64_t bitTrail, int32_t depth)
+{
+    auto nodeIdx = (int32_t)nodes_.size();
+    nodes_.emplace_back();
+
+    if (end - begin == 1) {
+        auto lightIdx = lights[begin].index;
+        nodes_[nodeIdx] = { lights[begin].bounds, lightIdx, true };
+        bitTrails_[lightIdx] = bitTrail;
+        inTree_[lightIdx] = 1;
+        return nodeIdx;
+    }
+
+    BBox bounds;
+    BBox centroidBounds;
+    for (size_t i = begin; i < end; ++i) {
+        bounds = boxUnion(bounds, lights[i].bounds.bounds);
+        centroidBounds = boxUnion(centroidBounds,
+            centroid(lights[i].bounds.bounds));
+    }
+
+    // Bucket the lights by centroid along every axis and pick the cheapest
+    // split between buckets
+    float bestCost = std::numeric_limits<float>::infinity();
+    int32_t bestDim = -1;
+    int32_t bestBucket = -1;
+    if (depth < maxCostSplitDepth) {
+        for (int32_t dim = 0; dim < 3; ++dim) {
+            float extent = centroidBounds.max[dim] - centroidBounds.min[dim];
+            if (extent <= 0.0f)
+                continue;
+
+            LightBounds buckets[bucketCount];
+            for (size_t i = begin; i < end; ++i) {
+                auto c = centroid(lights[i].bounds.bounds);
+                auto b = std::min(bucketCount - 1, (int32_t)(bucketCount
+                    * ((c[dim] - centroidBounds.min[dim]) / extent)));
+                buckets[b] = boundsUnion(buckets[b], lights[i].bounds);
+            }
+
+            for (int32_t split = 0; split < bucketCount - 1; ++split) {
+                LightBounds below;
+                LightBounds above;
+                for (int32_t b = 0; b <= split; ++b) {
+                    below = boundsUnion(below, buckets[b]);
+                }
+                for (int32_t b = split + 1; b < bucketCount; ++b) {
+                    above = boundsUnion(above, buckets[b]);
+                }
+
+                if (below.phi == 0.0f || above.phi == 0.0f)
+                    continue;
+
+                float cost = splitCost(below, bounds, dim)
+                    + splitCost(above, bounds, dim);
+                if (cost > 0.0f && cost < bestCost) {
+                    bestCost = cost;
+                    bestDim = dim;
+                    bestBucket = split;
+                }
+            }
+        }
+    }
+
+    size_t middle = (begin + end) / 2;
+    bool split = false;
+    if (bestDim >= 0) {
+        float extent = centroidBounds.max[bestDim] - centroidBounds.min[bestDim];
+        auto first = lights.begin() + begin;
+        auto last = lights.begin() + end;
+        auto mid = std::partition(first, last, [&](const BuildLight& light) {
+            auto c = centroid(light.bounds.bounds);
+            auto b = std::min(bucketCount - 1, (int32_t)(bucketCount
+                * ((c[bestDim] - centroidBounds.min[bestDim]) / extent)));
+            return b <= bestBucket;
+        });
+        if (mid != first && mid != last) {
+            middle = (size_t)(mid - lights.begin());
+            split = true;
+        }
+    }
+
+    if (!split) {
+        // No usable split, halve the list by position along the widest axis
+        auto dim = centroidBounds.maxExtent();
+        std::nth_element(lights.begin() + begin, lights.begin() + middle,
+            lights.begin() + end, [dim](const BuildLight& a, const BuildLight& b) {
+                return centroid(a.bounds.bounds)[dim] < centroid(b.bounds.bounds)[dim];
+            });
+    }
+
+    buildRecursive(lights, begin, middle, bitTrail, depth + 1);
+    auto second = buildRecursive(lights, middle, end,
+        bitTrail | ((uint64_t)1 << depth), depth + 1);
+
+    LightBounds nodeBounds;
+    for (size_t i = begin; i < end; ++i) {
+        nodeBounds = boundsUnion(nodeBounds, lights[i].bounds);
+    }
+    nodes_[nodeIdx] = { nodeBounds, second, false };
+
+    return nodeIdx;
+}
+
+int32_t LightBvh::sample(const Vector3f& position, const Vector3f& normal,
+    float u, float* pmf) const
+{
+    *pmf = 0.0f;
+    if (nodes_.empty() || importance(nodes_[0].bounds, position, normal) == 0.0f)
+        return -1;
+
+    float probability = 1.0f;
+    int32_t nodeIdx = 0;
+    for (;;) {
+        const auto& node = nodes_[nodeIdx];
+        if (node.isLeaf) {
+            *pmf = probability;
+            return node.index;
+        }
+
+        auto first = nodeIdx + 1;
+        auto second = node.index;
+        float i0 = importance(nodes_[first].bounds, position, normal);
+        float i1 = importance(nodes_[second].bounds, position, normal);
+        if (i0 == 0.0f && i1 == 0.0f)
+            return -1;
+
+        // Pick a child and rescale u to [0, 1) for the next level
+        float p0 = i0 / (i0 + i1);
+        if (u < p0) {
+            nodeIdx = first;
+            probability *= p0;
+            u = std::min(u / p0, 0.99999994f);
+        } else {
+            nodeIdx = second;
+            probability *= 1.0f - p0;
+            u = std::min((u - p0) / (1.0f - p0), 0.99999994f);
+        }
+    }
+}
+
+float LightBvh::pmf(const Vector3f& position, const Vector3f& normal,
+    int32_t lightIdx) const
+{
+    if (lightIdx < 0 || !inTree_[lightIdx]
+        || importance(nodes_[0].bounds, position, normal) == 0.0f)
+        return 0.0f;
+
+    auto bitTrail = bitTrails_[lightIdx];
+    float probability = 1.0f;
+    int32_t nodeIdx = 0;
+    for (;;) {
+        const auto& node = nodes_[nodeIdx];
+        if (node.isLeaf)
+            return probability;
+
+        auto first = nodeIdx + 1;
+        auto second = node.index;
+        float i0 = importance(nodes_[first].bounds, position, normal);
+        float i1 = importance(nodes_[second].bounds, position, normal);
+        if (i0 == 0.0f && i1 == 0.0f)
+            return 0.0f;
+
+        if (bitTrail & 1) {
+            probability *= i1 / (i0 + i1);
+            nodeIdx = second;
+        } else {
+            probability *= i0 / (i0 + i1);
+            nodeIdx = first;
+        }
+        bitTrail >>= 1;
+    }
+}
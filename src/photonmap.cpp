@@ -0,0 +1,257 @@
+#include "photonmap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "distribution.h"
+#include "integrator.h"
+#include "rng.h"
+#include "sampler.h"
+#include "scene.h"
+#include "scheduler.h"
+
+namespace {
+
+// Photons traced by a single task. Fixed, so that the photons of a pass don't
+// depend on the number of workers.
+constexpr int32_t photonsPerTask = 4096;
+// Longest specular chain followed
+constexpr int32_t maxPhotonDepth = 16;
+
+// Traces photons [begin, end) of a pass and appends the caustic ones to the
+// shared array
+template <typename TPhoton>
+class PhotonTask : public Task {
+public:
+    PhotonTask(const Scene& scene, const AliasTable& lightDistribution,
+        float invPhotonCount, uint64_t seed, int32_t begin, int32_t end,
+        TPhoton* photons, std::atomic<size_t>* photonCount)
+        : scene_(scene)
+        , lightDistribution_(lightDistribution)
+        , invPhotonCount_(invPhotonCount)
+        , seed_(seed)
+        , begin_(begin)
+        , end_(end)
+        , photons_(photons)
+        , photonCount_(photonCount)
+    { }
+
+    void run() override
+    {
+        using std::abs;
+
+        Rng rng;
+        rng.setSequence(mixBits(seed_ + (uint64_t)begin_), 0x5eed);
+
+        std::vector<TPhoton> stored;
+        const auto& lights = scene_.getLights();
+        for (auto i = begin_; i < end_; ++i) {
+            float lightPmf;
+            const auto& light = *lights[lightDistribution_.sample(
+                rng.randomFloat(), &lightPmf)];
+            float u1 = rng.randomFloat();
+            float u2 = rng.randomFloat();
+            float u3 = rng.randomFloat();
+            float u4 = rng.randomFloat();
+            auto ray = light.samplePhoton(u1, u2, u3, u4);
+            auto power = light.power() * (invPhotonCount_ / lightPmf);
+
+            bool specular = false;
+            for (auto depth = 0; depth < maxPhotonDepth; ++depth) {
+                RayHitInfo isect;
+                if (!scene_.intersect(ray, &isect) || !isect.bsdf)
+                    break;
+
+                if (!isect.bsdf->isDelta()) {
+                    if (specular && isect.bsdf->type() == BsdfType::Lambertian) {
+                        stored.push_back({ ray.orig + ray.dir * isect.t,
+                            -ray.dir, power });
+                    }
+                    break;
+                }
+
+                SurfaceHit hit(ray, isect);
+                Vector3f wi;
+                float pdf;
+                float v1 = rng.randomFloat();
+                float v2 = rng.randomFloat();
+                Spectrum refl = isect.bsdf->sample(hit.wo, &wi, v1, v2, &pdf);
+                if (pdf == 0.0f || refl.isBlack())
+                    break;
+
+                Vector3f dir = hit.frame.toWorld(wi);
+                power = power * refl * (abs(dot(dir, hit.nl)) / pdf);
+                ray = { hit.position + dir * EPS, dir };
+                specular = true;
+            }
+        }
+
+        // A single atomic add reserves the range of the whole task
+        auto first = photonCount_->fetch_add(stored.size(),
+            std::memory_order_relaxed);
+        std::copy(stored.begin(), stored.end(), photons_ + first);
+    }
+
+private:
+    const Scene& scene_;
+    const AliasTable& lightDistribution_;
+    float invPhotonCount_;
+    uint64_t seed_;
+    int32_t begin_;
+    int32_t end_;
+    TPhoton* photons_;
+    std::atomic<size_t>* photonCount_;
+};
+
+} // anonymous namespace
+
+CausticPhotonMap::CausticPhotonMap(const Scene& scene, int32_t photonCount,
+    float radius, float alpha)
+    : photonCount_(std::max(1, photonCount))
+    , alpha_(std::min(std::max(alpha, 0.0f), 1.0f))
+    , radius_(0.0f)
+    , nextRadius_(radius)
+    , passes_(1)
+    , invCellSize_(1.0f)
+    , bucketMask_(0)
+{
+    const auto& bounds = scene.getBounds();
+    if (nextRadius_ <= 0.0f)
+        nextRadius_ = length(bounds.max - bounds.min) / 500.0f;
+}
+
+void CausticPhotonMap::build(const Scene& scene)
+{
+    radius_ = nextRadius_;
+    nextRadius_ = radius_ * std::sqrt((passes_ + alpha_) / (passes_ + 1));
+
+    const auto& lights = scene.getLights();
+    std::vector<float> lightPower;
+    for (const auto& light : lights) {
+        lightPower.push_back(light->power().y());
+    }
+
+    // Each emitted photon stores at most one caustic photon
+    photons_.resize(photonCount_);
+    std::atomic<size_t> stored(0);
+
+    if (!lights.empty()) {
+        AliasTable lightDistribution(lightPower);
+        auto seed = (uint64_t)passes_ << 32;
+        auto invPhotonCount = 1.0f / photonCount_;
+
+        WorkQueue tasks;
+        for (auto begin = 0; begin < photonCount_; begin += photonsPerTask) {
+            auto end = std::min(photonCount_, begin + photonsPerTask);
+            tasks.push_back(std::make_unique<PhotonTask<Photon>>(scene,
+                lightDistribution, invPhotonCount, seed, begin, end,
+                photons_.data(), &stored));
+        }
+
+        enqueuTasks(tasks);
+        runTasks();
+        waitForCompletion();
+    }
+
+    photons_.resize(stored.load());
+    ++passes_;
+
+    // Bucket the photons by grid cell with a counting sort. Cells are twice
+    // the radius wide, the sphere around a lookup point overlaps 2 of them
+    // along each axis.
+    const auto& bounds = scene.getBounds();
+    gridOrigin_ = bounds.min - Vector3f(radius_);
+    invCellSize_ = 0.5f / radius_;
+
+    // Mostly empty buckets, so that lookups away from caustics, which are
+    // most of them, rarely find photons of other cells in their buckets
+    size_t bucketCount = 1;
+    while (bucketCount < 8 * photons_.size()) {
+        bucketCount *= 2;
+    }
+    bucketMask_ = bucketCount - 1;
+
+    photonBounds_ = BBox();
+    for (const auto& photon : photons_) {
+        photonBounds_ = boxUnion(photonBounds_, photon.position);
+    }
+    photonBounds_.min = photonBounds_.min - Vector3f(radius_);
+    photonBounds_.max = photonBounds_.max + Vector3f(radius_);
+
+    std::vector<uint32_t> photonBuckets(photons_.size());
+    bucketStart_.assign(bucketCount + 1, 0);
+    for (size_t i = 0; i < photons_.size(); ++i) {
+        int32_t cell[3];
+        gridCell(photons_[i].position, cell);
+        photonBuckets[i] = (uint32_t)bucket(cell[0], cell[1], cell[2]);
+        ++bucketStart_[photonBuckets[i] + 1];
+    }
+
+    for (size_t b = 0; b < bucketCount; ++b) {
+        bucketStart_[b + 1] += bucketStart_[b];
+    }
+
+    std::vector<Photon> sorted(photons_.size());
+    auto offsets = bucketStart_;
+    for (size_t i = 0; i < photons_.size(); ++i) {
+        sorted[offsets[photonBuckets[i]]++] = photons_[i];
+    }
+    photons_.swap(sorted);
+}
+
+void CausticPhotonMap::gridCell(const Vector3f& position, int32_t* cell) const
+{
+    auto offset = (position - gridOrigin_) * invCellSize_;
+    cell[0] = (int32_t)std::floor(offset.x);
+    cell[1] = (int32_t)std::floor(offset.y);
+    cell[2] = (int32_t)std::floor(offset.z);
+}
+
+size_t CausticPhotonMap::bucket(int32_t x, int32_t y, int32_t z) const
+{
+    auto key = (uint64_t)(uint32_t)x
+        ^ ((uint64_t)(uint32_t)y << 21)
+        ^ ((uint64_t)(uint32_t)z << 42);
+    return (size_t)mixBits(key) & bucketMask_;
+}
+
+Spectrum CausticPhotonMap::irradiance(const Vector3f& position,
+    const Vector3f& normal) const
+{
+    auto sum = Spectrum(0.0f);
+    const auto& bounds = photonBounds_;
+    if (photons_.empty()
+        || position.x < bounds.min.x || position.x > bounds.max.x
+        || position.y < bounds.min.y || position.y > bounds.max.y
+        || position.z < bounds.min.z || position.z > bounds.max.z) {
+        return sum;
+    }
+
+    auto radius2 = radius_ * radius_;
+    int32_t cell[3];
+    gridCell(position - Vector3f(radius_), cell);
+
+    // Neighbouring cells can share a bucket, visit each bucket once
+    size_t visited[8];
+    int32_t visitedCount = 0;
+    for (int32_t i = 0; i < 8; ++i) {
+        auto b = bucket(cell[0] + (i & 1), cell[1] + ((i >> 1) & 1),
+            cell[2] + (i >> 2));
+        if (std::find(visited, visited + visitedCount, b)
+            != visited + visitedCount) {
+            continue;
+        }
+        visited[visitedCount++] = b;
+
+        for (auto p = bucketStart_[b]; p < bucketStart_[b + 1]; ++p) {
+            const auto& photon = photons_[p];
+            if (length2(photon.position - position) < radius2
+                && dot(photon.wi, normal) > 0.0f) {
+                sum += photon.power;
+            }
+        }
+    }
+
+    return sum / (PI * radius2);
+}
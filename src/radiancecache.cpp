@@ -0,0 +1,141 @@
+#include "radiancecache.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "sampler.h"
+
+namespace {
+
+constexpr uint32_t cellCoordinateBits = 20;
+constexpr float maxCellCoordinate = (float)((1u << cellCoordinateBits) - 1);
+
+// Adds to an atomic float, std::atomic<float> has no fetch_add before C++20
+void atomicAdd(std::atomic<float>* target, float value)
+{
+    auto current = target->load(std::memory_order_relaxed);
+    while (!target->compare_exchange_weak(current, current + value,
+        std::memory_order_relaxed)) { }
+}
+
+} // namespace
+
+RadianceCache::RadianceCache(const BBox& bounds, float cellSize,
+    uint32_t minSamples, size_t maxBytes)
+    : origin_(bounds.min)
+    , minSamples_(std::max(1u, minSamples))
+    , usedCells_(0)
+{
+    if (cellSize <= 0.0f)
+        cellSize = length(bounds.max - bounds.min) / 128.0f;
+    invCellSize_ = cellSize > 0.0f ? 1.0f / cellSize : 1.0f;
+
+    // Largest power of two number of cells that fits
+    size_t capacity = 1024;
+    while (capacity * 2 * sizeof(Cell) <= maxBytes) {
+        capacity *= 2;
+    }
+    mask_ = capacity - 1;
+
+    cells_.reset(new Cell[capacity]);
+    for (size_t i = 0; i < capacity; ++i) {
+        auto& cell = cells_[i];
+        cell.key.store(0, std::memory_order_relaxed);
+        for (auto& sum : cell.sum) {
+            sum.store(0.0f, std::memory_order_relaxed);
+        }
+        cell.count.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t RadianceCache::cellKey(const Vector3f& position,
+    const Vector3f& normal) const
+{
+    using std::abs;
+
+    auto quantize = [this](float v) {
+        return (uint64_t)std::min(std::max(v * invCellSize_, 0.0f),
+            maxCellCoordinate);
+    };
+
+    auto offset = position - origin_;
+    uint64_t key = quantize(offset.x)
+        | (quantize(offset.y) << cellCoordinateBits)
+        | (quantize(offset.z) << (2 * cellCoordinateBits));
+
+    // Dominant axis of the normal and its sign
+    uint64_t axis = 0;
+    if (abs(normal.y) > abs(normal.x))
+        axis = 1;
+    if (abs(normal.z) > abs(axis == 0 ? normal.x : normal.y))
+        axis = 2;
+    auto negative = normal[axis] < 0.0f ? 1 : 0;
+    key |= (axis * 2 + negative) << (3 * cellCoordinateBits);
+
+    // Keep it distinct from the empty cell key
+    return key | (1ull << 63);
+}
+
+RadianceCache::Cell* RadianceCache::findCell(uint64_t key, bool insert) const
+{
+    auto slot = (size_t)mixBits(key);
+    for (uint32_t probe = 0; probe < maxProbes; ++probe, ++slot) {
+        auto& cell = cells_[slot & mask_];
+        auto cellKey = cell.key.load(std::memory_order_acquire);
+        if (cellKey == key)
+            return &cell;
+
+        if (cellKey != 0)
+            continue;
+
+        if (!insert)
+            return nullptr;
+
+        // Claim the empty cell, unless another worker got to it first with
+        // a different key
+        if (cell.key.compare_exchange_strong(cellKey, key,
+            std::memory_order_acq_rel)) {
+            usedCells_.fetch_add(1, std::memory_order_relaxed);
+            return &cell;
+        }
+        if (cellKey == key)
+            return &cell;
+    }
+    return nullptr;
+}
+
+void RadianceCache::add(const Vector3f& position, const Vector3f& normal,
+    const Spectrum& gathered, const Spectrum& weight)
+{
+    auto* cell = findCell(cellKey(position, normal), true);
+    if (!cell)
+        return;
+
+    auto value = gathered.toRGB();
+    auto w = weight.toRGB();
+    atomicAdd(&cell->sum[0], w.r > 0.0f ? value.r / w.r : 0.0f);
+    atomicAdd(&cell->sum[1], w.g > 0.0f ? value.g / w.g : 0.0f);
+    atomicAdd(&cell->sum[2], w.b > 0.0f ? value.b / w.b : 0.0f);
+    cell->count.fetch_add(1, std::memory_order_release);
+}
+
+bool RadianceCache::lookup(const Vector3f& position, const Vector3f& normal,
+    Spectrum* irradiance) const
+{
+    const auto* cell = findCell(cellKey(position, normal), false);
+    if (!cell)
+        return false;
+
+    // Records added while reading may be in the sums but not the count, the
+    // average is off by a fraction of a sample at most
+    auto count = cell->count.load(std::memory_order_acquire);
+    if (count < minSamples_)
+        return false;
+
+    auto invCount = 1.0f / count;
+    *irradiance = Spectrum(
+        cell->sum[0].load(std::memory_order_relaxed) * invCount,
+        cell->sum[1].load(std::memory_order_relaxed) * invCount,
+        cell->sum[2].load(std::memory_order_relaxed) * invCount);
+    return true;
+}
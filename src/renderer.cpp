@@ -1,223 +1,713 @@
 #include "renderer.h"
 
-#include "frame.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
 #include "platform.h"
-#include "rng.h"
 #include "scheduler.h"
+#include "timer.h"
 
 #include "camera.h"
-#include "light.h"
+#include "integrator.h"
+#include "sampler.h"
 #include "scene.h"
 #include "spectrum.h"
+#include "wavefront.h"
+
+// Starts sample k of the pixel on the sampler and returns its camera ray
+template <typename TSampler>
+FINLINE Ray cameraRay(TSampler& sampler, const Camera& camera, int32_t x,
+	int32_t y, int32_t k)
+{
+	sampler.startPixelSample(x, y, k);
+	auto pixelOffset = sampler.get2D();
+	return camera.sample(
+		x + pixelOffset.x - 0.5f,
+		y + pixelOffset.y - 0.5f
+	);
+}
 
-struct Tile {
-    Vector2i start;
-    Vector2i end;
+// Takes samples [sampleBegin, sampleEnd) of the pixel and adds them to the
+// camera sensor. Returns the number of rays traced.
+template <typename TIntegrator, typename TSampler>
+FINLINE uint64_t trace(const TIntegrator& integrator, TSampler& sampler,
+	const Scene& scene, Camera& camera, int32_t x, int32_t y,
+	int32_t sampleBegin, int32_t sampleEnd)
+{
+	uint64_t rays = 0;
+
+	auto finalColor = Spectrum(0.0f);
+	float lumaSqSum = 0.0f;
+	auto albedoSum = Spectrum(0.0f);
+	auto normalSum = Vector3f(0.0f);
+
+	for (int k = sampleBegin; k < sampleEnd; ++k) {
+		auto ray = cameraRay(sampler, camera, x, y, k);
+		PixelFeatures features;
+		auto color = integrator.li(scene, ray, sampler, &features, &rays);
+
+		finalColor += color;
+		lumaSqSum += color.y() * color.y();
+		albedoSum += features.albedo;
+		normalSum += features.normal;
+	}
 
-    Tile() { }
-    Tile(Vector2i start, Vector2i end) : start(start), end(end) { }
+    camera.accumulate(x, y, finalColor, lumaSqSum,
+        (uint32_t)(sampleEnd - sampleBegin), albedoSum, normalSum);
+
+    return rays;
+}
+
+// Samples taken by a single pass over the image
+struct PassInfo {
+    // Samples added to every active pixel
+    int32_t samples;
+    // Pixels below this count are brought up to it in one go
+    int32_t minSamples;
+    // No pixel gets more samples than this
+    int32_t maxSamples;
+    // One flag per pixel, row major. Inactive pixels are skipped.
+    const std::vector<uint8_t>* active;
+    // Index of the first sample of the pixels with no samples on the sensor.
+    // Nonzero when the sensor of a distributed worker gets a later range of
+    // samples.
+    int32_t firstSample;
+    // Pixels are not started after the deadline
+    bool hasDeadline;
+    Timer::Timepoint deadline;
+    // Pixels are not started once the flag is set, if there is one
+    const std::atomic<bool>* cancel;
 };
 
-class Integrator {
+// Measurements of a single task. A tile split between workers produces one
+// record per piece.
+struct TileRecord {
+    Vector2i index;
+    Timer::Timepoint start;
+    Timer::Timepoint end;
+    uint64_t rays;
+    uint64_t samples;
+};
+
+class TileRecorder {
 public:
-    virtual ~Integrator() = 0;
-    virtual void integrate(const Scene& scene, Camera& camera,
-        int32_t x, int32_t y) = 0;
+    void add(const TileRecord& record)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        records_.push_back(record);
+    }
+
+    const std::vector<TileRecord>& getRecords() const
+    {
+        return records_;
+    }
 
+private:
+    std::mutex mutex_;
+    std::vector<TileRecord> records_;
 };
 
-FINLINE void trace(const Scene& scene, Camera& camera, int32_t x, int32_t y)
-{
-	using std::abs;
+// Renders pixels of a tile in scanline order. The range of pixels left to
+// render is packed into a single atomic (next pixel in the low, end in the
+// high 32 bits), so that the worker claiming pixels and idle workers splitting
+// off the tail of the range don't need a lock. The task is specialized on the
+// integrator and sampler, so the per sample loop has no virtual calls. Batched
+// integrators get the samples of several pixels at once.
+template <typename TIntegrator, typename TSampler>
+class TileTask : public Task {
+public:
+	TileTask(const TIntegrator& integrator, const TSampler& sampler,
+		const Tile& tile, const Scene& scene, Camera& camera,
+		TileRecorder* recorder, const PassInfo& pass)
+		: TileTask(integrator, sampler, tile, scene, camera, recorder, pass, 0,
+			(tile.end.x - tile.start.x) * (tile.end.y - tile.start.y))
+	{ }
 
-	Rng rng(y * camera.getWidth() + x);
-	auto finalColor = Spectrum(0.0f);
-    RayHitInfo isect;
-    static constexpr int maxIter = 4096;
-    static const float invMaxIter = 1.0f / maxIter;
-	/*
-	 * This loop should be part of renderer task (concern). It only samples new
-	 * direction and gives it to integrator. Perhaps it can find the first
-	 * intersection...
-	 */
-	for (int k = 0; k < maxIter; ++k) {
-		Spectrum color { 0.0f };
-		Spectrum pathWeight { 1.0f };
-
-        auto currentRay = camera.sample(
-            x + rng.randomFloat() - 0.5f,
-            y + rng.randomFloat() - 0.5f
-        );
-
-		bool evaluateDirectLightHit = true;
-
-		/*
-		 * This loop should be part of integrator, so that its easily seperable
-		 * from renderer
-		 */
-		for (auto bounce = 0; bounce < 10; ++bounce) {
-			if (!scene.intersect(currentRay, &isect))
-				break;
+	TileTask(const TIntegrator& integrator, const TSampler& sampler,
+		const Tile& tile, const Scene& scene, Camera& camera,
+		TileRecorder* recorder, const PassInfo& pass, uint32_t begin,
+		uint32_t end)
+		: integrator_(integrator)
+		, sampler_(sampler)
+		, tile_(tile)
+		, scene_(scene)
+		, camera_(camera)
+		, recorder_(recorder)
+		, pass_(pass)
+		, range_(packRange(begin, end))
+		, done_(0)
+		, startTime_(Timer::Clock::now())
+	{ }
 
-			if (evaluateDirectLightHit && isect.areaLight) {
-				color += pathWeight * isect.areaLight->intensity();
-			}
+	void run() override
+	{
+		TileRecord record;
+		record.index = tile_.index;
+		record.rays = 0;
+		record.samples = 0;
+		record.start = Timer::Clock::now();
+		startTime_ = record.start;
+
+		if constexpr (IsBatched<TIntegrator>::value) {
+			runBatched(&record);
+		} else {
+			runPixels(&record);
+		}
 
-			if (!isect.bsdf)
-				break;
+		record.end = Timer::Clock::now();
+		recorder_->add(record);
+	}
 
-			/*
-			 * variables used below:
-			 * wi - incident direction
-			 * wo - outgoing direction
-			 */
-			Vector3f intersection = currentRay.orig + (currentRay.dir * isect.t);
-            auto norm = isect.shadingNormal;
-			Vector3f nl = dot(isect.normal, currentRay.dir) < 0.0f ? norm : norm * -1.0f;
-
-			auto hitFrame = Frame(nl);
-			const auto wo = hitFrame.toLocal(-currentRay.dir);
-
-			/*
-			 * sample lights
-			 */
-			Vector3f wi;
-			float pdf;
-
-			const auto& lights = scene.getLights();
-			int32_t numLights = static_cast<int32_t>(lights.size());
-
-			int32_t lightIdx = std::min(
-				static_cast<int32_t>(rng.randomFloat() * numLights),
-				numLights - 1
-			);
-
-			const auto& light = lights[lightIdx];
-			float eps;
-			Vector3f sampledPosition;
-			Spectrum lightEmission = light->sample(intersection, &wi, &pdf,
-				&sampledPosition, &eps, rng.randomFloat(), rng.randomFloat());
-
-			auto lightRay = Ray(intersection + wi * EPS, wi);
-			lightRay.maxT = length(intersection - sampledPosition) - eps;
-
-			if (!scene.intersectShadow(lightRay)) {
-				Spectrum f = isect.bsdf->f(wo, wi);
-				color = color + (pathWeight * f * lightEmission
-					* (abs(dot(nl, wi)) / pdf) * (float)numLights);
+	std::unique_ptr<Task> split() override
+	{
+		auto range = range_.load();
+		for (;;) {
+			auto next = rangeBegin(range);
+			auto end = rangeEnd(range);
+			// Leave the pixel currently being rendered and at least one more
+			// to the owner
+			if (end - next < 2)
+				return nullptr;
+
+			auto middle = next + (end - next + 1) / 2;
+			if (range_.compare_exchange_weak(range, packRange(next, middle))) {
+				return std::make_unique<TileTask>(integrator_, sampler_, tile_,
+					scene_, camera_, recorder_, pass_, middle, end);
 			}
+		}
+	}
 
-			/*
-             * continue tracing
-             */
-			float continueProbability = pathWeight.y();
-			if (rng.randomFloat() > continueProbability)
-				break;
+	double remaining() const override
+	{
+		using Seconds = std::chrono::duration<double>;
+
+		auto range = range_.load(std::memory_order_relaxed);
+		auto left = rangeEnd(range) - std::min(rangeBegin(range), rangeEnd(range));
+		auto elapsed = Seconds(Timer::Clock::now() - startTime_.load()).count();
+		// Before the first pixel finishes, the time spent so far is a lower
+		// bound of the time per pixel
+		auto perPixel = elapsed / std::max(1u, done_.load(std::memory_order_relaxed));
+		return perPixel * left;
+	}
 
-			pathWeight /= continueProbability;
-			Spectrum refl = isect.bsdf->sample(wo, &wi, rng.randomFloat(),
-				rng.randomFloat(), &pdf);
+private:
+	static uint64_t packRange(uint32_t begin, uint32_t end)
+	{
+		return ((uint64_t)end << 32) | begin;
+	}
 
-			if (refl.y() == 0.0f)
-				break;
+	static uint32_t rangeBegin(uint64_t range)
+	{
+		return (uint32_t)range;
+	}
 
-			evaluateDirectLightHit = isect.bsdf->isDelta();
+	static uint32_t rangeEnd(uint64_t range)
+	{
+		return (uint32_t)(range >> 32);
+	}
 
-			Vector3f dir = hitFrame.toWorld(wi);
+	bool claimPixel(uint32_t* pixel)
+	{
+		auto range = range_.load();
+		for (;;) {
+			if (rangeBegin(range) >= rangeEnd(range))
+				return false;
+			if (range_.compare_exchange_weak(range, range + 1)) {
+				*pixel = rangeBegin(range);
+				return true;
+			}
+		}
+	}
 
-			pathWeight = pathWeight * refl * abs(dot(dir, nl)) / pdf;
-			currentRay = { intersection + dir * EPS, dir };
+	// Claims the next active pixel and the samples it takes in this pass.
+	// Returns false when the range is done, the deadline has passed or the
+	// render was cancelled. The caller counts the pixel as done once it is
+	// rendered.
+	bool claimSamples(int32_t* x, int32_t* y, int32_t* sampleBegin,
+		int32_t* sampleEnd)
+	{
+		const auto& active = *pass_.active;
+		const auto& sensor = camera_.getSensor();
+		auto width = camera_.getWidth();
+		auto tileWidth = tile_.end.x - tile_.start.x;
+		uint32_t pixel;
+		while (claimPixel(&pixel)) {
+			if (pass_.hasDeadline && Timer::Clock::now() >= pass_.deadline)
+				return false;
+			if (pass_.cancel && pass_.cancel->load(std::memory_order_relaxed))
+				return false;
+
+			*x = tile_.start.x + (int32_t)pixel % tileWidth;
+			*y = tile_.start.y + (int32_t)pixel / tileWidth;
+			if (active[*y * width + *x]) {
+				// Continue the sample sequence of the pixel where the previous
+				// pass stopped
+				*sampleBegin = pass_.firstSample
+					+ (int32_t)sensor.sampleCount(*x, *y);
+				auto samples = std::max(pass_.samples,
+					pass_.minSamples - *sampleBegin);
+				*sampleEnd = std::min(pass_.maxSamples, *sampleBegin + samples);
+				return true;
+			}
+			done_.fetch_add(1, std::memory_order_relaxed);
 		}
+		return false;
+	}
 
-		finalColor = finalColor + (color * invMaxIter);
+	void runPixels(TileRecord* record)
+	{
+		// Sampler state is per worker, copy the prototype
+		auto sampler = sampler_;
+		int32_t x, y, sampleBegin, sampleEnd;
+		while (claimSamples(&x, &y, &sampleBegin, &sampleEnd)) {
+			record->rays += trace(integrator_, sampler, scene_, camera_, x, y,
+				sampleBegin, sampleEnd);
+			record->samples += sampleEnd - sampleBegin;
+			done_.fetch_add(1, std::memory_order_relaxed);
+		}
 	}
 
-    camera.accumulate(x, y, finalColor.toRGB());
-}
+	// Fills batches of paths from whole pixels and traces them together
+	void runBatched(TileRecord* record)
+	{
+		struct BatchPixel {
+			int32_t x;
+			int32_t y;
+			uint32_t firstPath;
+			uint32_t samples;
+		};
+
+		auto sampler = sampler_;
+		auto batchSize = (size_t)integrator_.batchSize();
+		std::vector<BatchPixel> pixels;
+		std::vector<WavefrontPath<TSampler>> paths;
+		WavefrontQueues queues;
+
+		bool morePixels = true;
+		while (morePixels) {
+			pixels.clear();
+			paths.clear();
+
+			int32_t x, y, sampleBegin, sampleEnd;
+			while (paths.size() < batchSize) {
+				if (!claimSamples(&x, &y, &sampleBegin, &sampleEnd)) {
+					morePixels = false;
+					break;
+				}
+
+				pixels.push_back({ x, y, (uint32_t)paths.size(),
+					(uint32_t)(sampleEnd - sampleBegin) });
+				for (auto k = sampleBegin; k < sampleEnd; ++k) {
+					auto ray = cameraRay(sampler, camera_, x, y, k);
+					paths.emplace_back(ray, sampler);
+				}
+			}
 
-class TileTask : public Task {
-public:
-	TileTask(const Tile& tile, const Scene& scene, Camera& camera)
-		: tile_(tile)
-		, scene_(scene)
-		, camera_(camera)
-	{ }
+			if (pixels.empty())
+				break;
 
-	void run() override
-	{
-		for (int32_t y = tile_.start.y; y < tile_.end.y; ++y) {
-			for (int32_t x = tile_.start.x; x < tile_.end.x; ++x) {
-				trace(scene_, camera_, x, y);
+			integrator_.li(scene_, paths, &queues, &record->rays);
+
+			for (const auto& pixel : pixels) {
+				auto finalColor = Spectrum(0.0f);
+				float lumaSqSum = 0.0f;
+				auto albedoSum = Spectrum(0.0f);
+				auto normalSum = Vector3f(0.0f);
+				for (uint32_t k = 0; k < pixel.samples; ++k) {
+					const auto& path = paths[pixel.firstPath + k];
+					finalColor += path.color;
+					lumaSqSum += path.color.y() * path.color.y();
+					albedoSum += path.features.albedo;
+					normalSum += path.features.normal;
+				}
+				camera_.accumulate(pixel.x, pixel.y, finalColor, lumaSqSum,
+					pixel.samples, albedoSum, normalSum);
+				record->samples += pixel.samples;
 			}
+			done_.fetch_add((uint32_t)pixels.size(), std::memory_order_relaxed);
 		}
 	}
 
-private:
+	TIntegrator integrator_;
+	TSampler sampler_;
 	Tile tile_;
 	const Scene& scene_;
 	Camera& camera_;
+	TileRecorder* recorder_;
+	PassInfo pass_;
+	std::atomic<uint64_t> range_;
+	std::atomic<uint32_t> done_;
+	std::atomic<Timer::Timepoint> startTime_;
 };
 
-void Renderer::render(const Scene& scene, Camera& camera) const
+void Renderer::render(const Scene& scene, Camera& camera)
 {
-    Vector2i numFullTiles;
-    numFullTiles.x = camera.getWidth() / tileSize_;
-    numFullTiles.y = camera.getHeight() / tileSize_;
-
-    std::vector<std::unique_ptr<Task>> tiles;
-    tiles.reserve(numFullTiles.x * numFullTiles.y);
-
-    Vector2i start;
-    Vector2i end;
-
-    for (auto i = 0; i < numFullTiles.x; ++i) {
-        for (auto j = 0; j < numFullTiles.y; ++j) {
-            start.x = i * tileSize_;
-            start.y = j * tileSize_;
-            end.x = (i + 1) * tileSize_;
-            end.y = (j + 1) * tileSize_;
-            tiles.push_back(std::make_unique<TileTask>(
-                Tile(start, end), scene, camera
-            ));
+    // The only runtime dispatch on the integrator and sampler, everything
+    // below is instantiated per combination
+    const auto& integrator = settings_.integrator;
+    radianceCache_.reset();
+    causticMap_.reset();
+    guidingTree_.reset();
+    switch (integrator.type) {
+    case IntegratorType::PathTracer:
+        if (integrator.radianceCache) {
+            radianceCache_ = std::make_unique<RadianceCache>(scene.getBounds(),
+                integrator.cacheCellSize,
+                (uint32_t)std::max(1, integrator.cacheMinSamples),
+                (size_t)std::max(1, integrator.cacheMegabytes) << 20);
         }
+        if (integrator.caustics) {
+            causticMap_ = std::make_unique<CausticPhotonMap>(scene,
+                integrator.causticPhotons, integrator.causticRadius,
+                integrator.causticAlpha);
+        }
+        if (integrator.guiding && integrator.guidingIterations > 0) {
+            guidingTree_ = std::make_unique<GuidingTree>(scene.getBounds(),
+                (size_t)std::max(1, integrator.guidingMegabytes) << 20);
+        }
+        renderWithSampler(scene, camera, PathTracer(integrator,
+            radianceCache_.get(), causticMap_.get(), guidingTree_.get()));
+        break;
+    case IntegratorType::DirectLighting:
+        renderWithSampler(scene, camera, DirectLighting(integrator));
+        break;
+    case IntegratorType::AmbientOcclusion:
+        renderWithSampler(scene, camera, AmbientOcclusion(integrator, scene));
+        break;
+    case IntegratorType::Normals:
+        renderWithSampler(scene, camera, NormalsIntegrator(integrator));
+        break;
+    case IntegratorType::Headlight:
+        renderWithSampler(scene, camera, HeadlightIntegrator(integrator));
+        break;
+    case IntegratorType::Wavefront:
+        renderWithSampler(scene, camera, WavefrontPathTracer(integrator));
+        break;
     }
 
-    auto leftoverWidth = camera.getWidth() - numFullTiles.x * tileSize_;
-    if (leftoverWidth > 0) {
-        for (auto i = 0; i < numFullTiles.y; ++i) {
-            start.x = numFullTiles.x * tileSize_;
-            start.y = i * tileSize_;
-            end.x = camera.getWidth();
-            end.y = (i + 1) * tileSize_;
-            tiles.push_back(std::make_unique<TileTask>(
-                Tile(start, end), scene, camera
-            ));
+    if (radianceCache_) {
+        stats_.cacheCells = radianceCache_->cellCount();
+        stats_.cacheCapacity = radianceCache_->capacity();
+    }
+    if (guidingTree_)
+        stats_.guidingCells = guidingTree_->cellCount();
+}
+
+void Renderer::renderRegion(const Scene& scene, Camera& camera,
+    const Tile& region, int32_t sampleBegin, int32_t sampleEnd)
+{
+    Region job = { region, sampleBegin, sampleEnd };
+    region_ = &job;
+    render(scene, camera);
+    region_ = nullptr;
+}
+
+template <typename TIntegrator>
+void Renderer::renderWithSampler(const Scene& scene, Camera& camera,
+    const TIntegrator& integrator)
+{
+    auto resolution = camera.getResolution();
+    auto spp = settings_.samplesPerPixel;
+    switch (settings_.sampler) {
+    case SamplerType::Independent:
+        renderPasses(scene, camera, integrator,
+            IndependentSampler(resolution, spp));
+        break;
+    case SamplerType::Stratified:
+        renderPasses(scene, camera, integrator,
+            StratifiedSampler(resolution, spp));
+        break;
+    case SamplerType::Halton:
+        renderPasses(scene, camera, integrator, HaltonSampler(resolution, spp));
+        break;
+    case SamplerType::Sobol:
+        renderPasses(scene, camera, integrator, SobolSampler(resolution, spp));
+        break;
+    }
+}
+
+template <typename TIntegrator, typename TSampler>
+void Renderer::renderPasses(const Scene& scene, Camera& camera,
+    const TIntegrator& integrator, const TSampler& sampler)
+{
+    using Seconds = std::chrono::duration<double>;
+
+    if (region_) {
+        renderRegionPass(scene, camera, integrator, sampler);
+        return;
+    }
+
+    const auto& sensor = camera.getSensor();
+    auto numPixels = (uint64_t)camera.getWidth() * camera.getHeight();
+    auto spp = std::max(1, settings_.samplesPerPixel);
+    auto adaptive = settings_.adaptiveError > 0.0f;
+
+    PassInfo pass;
+    pass.samples = std::min(spp, std::max(1, settings_.samplesPerPass));
+    pass.minSamples = adaptive ? std::min(spp, settings_.minSamples) : 0;
+    pass.maxSamples = spp;
+    pass.firstSample = 0;
+    if (adaptive) {
+        pass.maxSamples = settings_.maxSamples > 0
+            ? std::max(spp, settings_.maxSamples) : 4 * spp;
+    }
+
+    // Adaptive sampling moves samples between pixels, but keeps the total
+    auto budget = spp * numPixels;
+
+    std::vector<uint8_t> active(numPixels);
+    pass.active = &active;
+
+    stats_ = RenderStats();
+    tileCosts_.clear();
+
+    auto initialSamples = sensor.totalSamples();
+    auto samplesPerPass = pass.samples;
+
+    auto frameStart = Timer::Clock::now();
+    auto timeBudget = settings_.timeBudget > 0.0;
+    pass.hasDeadline = timeBudget;
+    pass.deadline = frameStart + std::chrono::duration_cast<Timer::Clock::duration>(
+        Seconds(settings_.timeBudget));
+    pass.cancel = cancel_;
+    // Measured cost of a single sample, drives the pass size when rendering
+    // against the clock
+    double secondsPerSample = 0.0;
+    // Guiding iteration k trains for 2^k passes
+    int32_t guidingPasses = 0;
+
+    for (;;) {
+        auto activePixels = updateActivePixels(sensor, pass, &active);
+        if (activePixels == 0)
+            break;
+
+        // Shrink the last pass, so that the budget isn't overshot by a whole
+        // pass worth of samples
+        auto taken = initialSamples + stats_.samples;
+        auto remaining = budget > taken ? budget - taken : 0;
+        pass.samples = (int32_t)std::max<uint64_t>(1, std::min<uint64_t>(
+            samplesPerPass, remaining / activePixels));
+
+        if (timeBudget) {
+            // Start with a single sample per pixel to measure the cost, after
+            // that let every pass take half of the remaining time. Passes get
+            // shorter towards the deadline, so when the deadline cuts a pass
+            // short pixels differ by just a few samples.
+            auto passStart = Timer::Clock::now();
+            if (passStart >= pass.deadline)
+                break;
+
+            auto secondsLeft = Seconds(pass.deadline - passStart).count();
+            auto passSamples = secondsPerSample > 0.0
+                ? 0.5 * secondsLeft / (secondsPerSample * activePixels) : 1.0;
+            pass.samples = std::max(1, std::min(pass.samples, (int32_t)passSamples));
+        }
+
+        auto passStart = Timer::Clock::now();
+        auto samplesBefore = stats_.samples;
+        if (causticMap_) {
+            causticMap_->build(scene);
+            stats_.causticPhotons = causticMap_->storedPhotons();
+            stats_.causticRadius = causticMap_->radius();
+        }
+        renderPass(integrator, sampler, scene, camera, pass);
+
+        if (cancel_ && cancel_->load())
+            break;
+
+        if (guidingTree_ && guidingTree_->training()
+            && ++guidingPasses >= (1 << stats_.guidingIterations)) {
+            guidingTree_->refine(stats_.guidingIterations);
+            stats_.guidingIterations += 1;
+            guidingPasses = 0;
+            if (stats_.guidingIterations >= settings_.integrator.guidingIterations)
+                guidingTree_->setTraining(false);
         }
+
+        auto passSamples = stats_.samples - samplesBefore;
+        if (passSamples > 0) {
+            secondsPerSample =
+                Seconds(Timer::Clock::now() - passStart).count() / passSamples;
+        }
+
+        stats_.passes += 1;
+        stats_.activePixels = activePixels;
+        stats_.samplesPerPixel = (float)((double)stats_.samples / numPixels);
+        stats_.seconds = Seconds(Timer::Clock::now() - frameStart).count();
+        if (stats_.seconds > 0.0)
+            stats_.raysPerSecond = stats_.rays / stats_.seconds;
+
+        // Error estimation touches every pixel, only do it when something
+        // is going to look at it
+        auto lastPass = initialSamples + stats_.samples >= budget
+            || (timeBudget && Timer::Clock::now() >= pass.deadline)
+            || (settings_.maxPasses > 0 && stats_.passes >= settings_.maxPasses);
+        if (settings_.targetError > 0.0f || passCallback_ || lastPass)
+            stats_.error = sensor.averageError();
+
+        if (passCallback_ && !passCallback_(stats_, camera))
+            break;
+
+        if (lastPass)
+            break;
+
+        if (settings_.targetError > 0.0f && stats_.error <= settings_.targetError)
+            break;
     }
 
-    auto leftoverHeight = camera.getHeight() - numFullTiles.y * tileSize_;
-    if (leftoverHeight > 0) {
-        for (auto i = 0; i < numFullTiles.x; ++i) {
-            start.x = i * tileSize_;
-            start.y = numFullTiles.y * tileSize_;
-            end.x = (i + 1) * tileSize_;
-            end.y = camera.getHeight();
-            tiles.push_back(std::make_unique<TileTask>(
-                Tile(start, end), scene, camera
-            ));
+    auto frameEnd = Timer::Clock::now();
+    stats_.seconds = Seconds(frameEnd - frameStart).count();
+    if (timeBudget)
+        stats_.overshootSeconds = Seconds(frameEnd - pass.deadline).count();
+    stats_.minSamplesPerPixel = sensor.minSampleCount();
+}
+
+template <typename TIntegrator, typename TSampler>
+void Renderer::renderRegionPass(const Scene& scene, Camera& camera,
+    const TIntegrator& integrator, const TSampler& sampler)
+{
+    using Seconds = std::chrono::duration<double>;
+
+    const auto& tile = region_->tile;
+    auto width = camera.getWidth();
+    std::vector<uint8_t> active((size_t)width * camera.getHeight(), 0);
+    for (int32_t y = tile.start.y; y < tile.end.y; ++y) {
+        for (int32_t x = tile.start.x; x < tile.end.x; ++x) {
+            active[y * width + x] = 1;
         }
     }
 
-    if (leftoverWidth > 0 && leftoverHeight > 0) {
-        tiles.push_back(std::make_unique<TileTask>(Tile(
-            Vector2i(numFullTiles.x * tileSize_, numFullTiles.y * tileSize_),
-            Vector2i(camera.getWidth(), camera.getHeight())),
-            scene, camera
-        ));
+    PassInfo pass;
+    pass.samples = std::max(0, region_->sampleEnd - region_->sampleBegin);
+    pass.minSamples = 0;
+    pass.maxSamples = region_->sampleEnd;
+    pass.active = &active;
+    pass.firstSample = region_->sampleBegin;
+    pass.hasDeadline = false;
+    pass.cancel = cancel_;
+
+    stats_ = RenderStats();
+    tileCosts_.clear();
+
+    auto start = Timer::Clock::now();
+    renderPass(integrator, sampler, scene, camera, pass);
+
+    stats_.passes = 1;
+    stats_.seconds = Seconds(Timer::Clock::now() - start).count();
+    if (stats_.seconds > 0.0)
+        stats_.raysPerSecond = stats_.rays / stats_.seconds;
+}
+
+int64_t Renderer::updateActivePixels(const Sensor& sensor, const PassInfo& pass,
+    std::vector<uint8_t>* active) const
+{
+    auto adaptive = settings_.adaptiveError > 0.0f;
+    auto width = sensor.getWidth();
+    int64_t activePixels = 0;
+
+    for (int32_t y = 0; y < sensor.getHeight(); ++y) {
+        for (int32_t x = 0; x < width; ++x) {
+            auto count = (int32_t)sensor.sampleCount(x, y);
+            bool isActive = count < pass.minSamples;
+            if (!isActive && count < pass.maxSamples) {
+                isActive = !adaptive
+                    || sensor.relativeError(x, y) > settings_.adaptiveError;
+            }
+            (*active)[y * width + x] = isActive ? 1 : 0;
+            activePixels += isActive ? 1 : 0;
+        }
     }
 
-    enqueuTasks(tiles);
+    return activePixels;
+}
+
+template <typename TIntegrator, typename TSampler>
+void Renderer::renderPass(const TIntegrator& integrator, const TSampler& sampler,
+    const Scene& scene, Camera& camera, const PassInfo& pass)
+{
+    using Seconds = std::chrono::duration<double>;
+
+    auto width = camera.getWidth();
+    auto grid = tileGridSize(camera.getResolution(), tileSize_);
+    auto tiles = makeTiles(camera.getResolution(), tileSize_, tileOrder_,
+        tileCosts_);
+
+    TileRecorder recorder;
+
+    // The scheduler hands out tasks from the back of the queue, so enqueue
+    // them in reverse to run the tiles in the requested order. Tiles without
+    // active pixels are skipped.
+    WorkQueue tasks;
+    tasks.reserve(tiles.size());
+    for (size_t i = tiles.size(); i-- > 0;) {
+        const auto& tile = tiles[i];
+        bool anyActive = false;
+        for (int32_t y = tile.start.y; y < tile.end.y && !anyActive; ++y) {
+            for (int32_t x = tile.start.x; x < tile.end.x && !anyActive; ++x) {
+                anyActive = (*pass.active)[y * width + x] != 0;
+            }
+        }
+
+        if (anyActive) {
+            tasks.push_back(std::make_unique<TileTask<TIntegrator, TSampler>>(
+                integrator, sampler, tile, scene, camera, &recorder, pass
+            ));
+        }
+    }
+
+    resetSchedulerStats();
+    auto passStart = Timer::Clock::now();
+    enqueuTasks(tasks);
     runTasks();
     waitForCompletion();
+    auto passEnd = Timer::Clock::now();
+
+    auto lastStart = passStart;
+    tileCosts_.assign(grid.x * grid.y, 0.0f);
+    for (const auto& record : recorder.getRecords()) {
+        const auto& index = record.index;
+        tileCosts_[index.y * grid.x + index.x] +=
+            (float)Seconds(record.end - record.start).count();
+        lastStart = std::max(lastStart, record.start);
+        stats_.rays += record.rays;
+        stats_.samples += record.samples;
+    }
+
+    for (auto cost : tileCosts_) {
+        stats_.maxTileSeconds = std::max(stats_.maxTileSeconds, (double)cost);
+    }
+
+    auto schedStats = schedulerStats();
+    stats_.idleSeconds += schedStats.idleSeconds;
+    stats_.splits += schedStats.splits;
+    stats_.tailSeconds += Seconds(passEnd - lastStart).count();
 }
 
+void printRenderStats(const RenderStats& stats)
+{
+    printf("Frame time:       %.3fs\n", stats.seconds);
+    printf("Passes:           %d (%.1f spp, minimum %u, average relative error %.4f)\n",
+        stats.passes, stats.samplesPerPixel, stats.minSamplesPerPixel, stats.error);
+    printf("Rays traced:      %llu (%.2f Mrays/s)\n",
+        (unsigned long long)stats.rays, stats.raysPerSecond * 1e-6);
+    printf("Frame tail:       %.3fs (slowest tile %.3fs)\n",
+        stats.tailSeconds, stats.maxTileSeconds);
+    printf("Idle worker time: %.3fs (%llu tile splits)\n",
+        stats.idleSeconds, (unsigned long long)stats.splits);
+    if (stats.cacheCapacity > 0) {
+        printf("Radiance cache:   %llu of %llu cells used\n",
+            (unsigned long long)stats.cacheCells,
+            (unsigned long long)stats.cacheCapacity);
+    }
+    if (stats.causticPhotons > 0) {
+        printf("Caustic photons:  %llu in the last pass (radius %g)\n",
+            (unsigned long long)stats.causticPhotons, stats.causticRadius);
+    }
+    if (stats.guidingCells > 0) {
+        printf("Path guiding:     %llu cells, %d training iterations\n",
+            (unsigned long long)stats.guidingCells, stats.guidingIterations);
+    }
+}
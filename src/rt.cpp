@@ -1,57 +1,1149 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
 
 #include "timer.h"
 
 #include "camera.h"
+#include "camerapath.h"
+#include "checkpoint.h"
+#include "denoiser.h"
+#include "distributed.h"
+#include "imagewriter.h"
+#include "interactive.h"
 #include "renderer.h"
 #include "scene.h"
 #include "scheduler.h"
+#include "server.h"
 
-int main(int /*argc*/, const char* /*argv*/[])
+struct Options {
+    std::string sceneName = "obj";
+    std::string objFolder = "/Users/marcin/projects/rt/scenes/cornell-box/";
+    std::string objFile = "CornellBox-Mirror.obj";
+    std::string output = "image.bmp";
+    int32_t width = 1024;
+    int32_t height = 768;
+    // Camera position and look at point, the scene default unless set
+    bool customCamera = false;
+    Vector3f cameraPosition;
+    Vector3f cameraTarget;
+    TileOrder tileOrder = TileOrder::Hilbert;
+    RenderSettings settings;
+    LightSampling lightSampling = LightSampling::Power;
+    // Write the image after every pass
+    bool savePasses = false;
+    std::string sampleMap;
+    // Denoise the image before writing it
+    bool denoise = false;
+    DenoiseSettings denoiseSettings;
+    // Feature images of the denoiser
+    std::string albedoOutput;
+    std::string normalsOutput;
+    // Time budget of each preview frame, 0 renders the final image instead
+    double preview = 0.0;
+    // Render state is saved to checkpoint between passes, at most once per
+    // interval, and once more at the end
+    std::string checkpoint;
+    double checkpointInterval = 60.0;
+    // Checkpoint to continue rendering from
+    std::string resume;
+    // Address a coordinator waits for workers at, or a worker connects to
+    std::string coordinator;
+    std::string worker;
+    // Seconds without word from a worker before its job is handed out again
+    double workerTimeout = 30.0;
+    // Render only samples [sampleBegin, sampleEnd) of every pixel, when
+    // sampleEnd is set, for rt --merge to add up with other ranges
+    int32_t sampleBegin = 0;
+    int32_t sampleEnd = 0;
+    // File for the float sums of the render
+    std::string partial;
+    // Partial renders to add up instead of rendering
+    std::vector<std::string> merge;
+    // Address a render server listens at, or a client sends its render to
+    std::string server;
+    std::string client;
+    // Memory the resident scenes of a render server may take
+    int32_t serverMegabytes = 1024;
+    // Client asks the server to stop instead of rendering
+    bool stopServer = false;
+    // Camera moves of the interactive benchmark, 0 renders a single frame
+    int32_t interactiveMoves = 0;
+    // Keyframes of a sequence and the frames spread over them, 0 for a frame
+    // per keyframe
+    std::string cameraPath;
+    int32_t frames = 0;
+    // Frames of a turntable sequence around the scene
+    int32_t turntableFrames = 0;
+};
+
+static void printUsage(const char* name)
+{
+    printf("Usage: %s [options]\n", name);
+    printf("  --scene cornell            render the built in cornell box\n");
+    printf("  --obj <folder> <file>      render obj scene\n");
+    printf("  --width <n>                image width\n");
+    printf("  --height <n>               image height\n");
+    printf("  --camera <px py pz tx ty tz>  camera position and look at point\n");
+    printf("  --tile-order <order>       column, morton, hilbert, spiral, cost\n");
+    printf("  --output <file>            output bitmap name\n");
+    printf("  --spp <n>                  samples per pixel\n");
+    printf("  --pass-spp <n>             samples per pixel in a single pass\n");
+    printf("  --max-passes <n>           stop after n passes\n");
+    printf("  --target-error <e>         stop at average relative error e\n");
+    printf("  --save-passes              write the image after every pass\n");
+    printf("  --adaptive <e>             stop sampling pixels at relative error e\n");
+    printf("  --min-spp <n>              adaptive sampling minimum samples per pixel\n");
+    printf("  --max-spp <n>              adaptive sampling maximum samples per pixel\n");
+    printf("  --sample-map <file>        write samples per pixel map\n");
+    printf("  --denoise                  denoise the image before writing it\n");
+    printf("  --denoise-iterations <n>   denoiser passes, footprint 2^(n+2) pixels\n");
+    printf("  --albedo <file>            write first hit albedo\n");
+    printf("  --normals <file>           write first hit shading normals\n");
+    printf("  --time <seconds>           render until the time budget runs out\n");
+    printf("  --preview <seconds>        render headlight, direct and ao previews\n");
+    printf("  --checkpoint <file>        save the render state between passes (see\n");
+    printf("                             --pass-spp) and at the end\n");
+    printf("  --checkpoint-interval <s>  seconds between checkpoints, 0 for every pass\n");
+    printf("  --resume <file>            continue the render saved in a checkpoint\n");
+    printf("  --coordinator <address>    hand the frame out to worker processes,\n");
+    printf("                             address is host:port or unix:path\n");
+    printf("  --worker <address>         render jobs of the coordinator at address\n");
+    printf("  --worker-timeout <s>       seconds before a silent worker is dropped\n");
+    printf("  --sample-range <b> <e>     render samples b to e - 1 of every pixel\n");
+    printf("  --partial <file>           write the float sums of the render\n");
+    printf("  --merge <file>...          add up partial renders of disjoint sample\n");
+    printf("                             ranges and write the outputs\n");
+    printf("  --server <address>         keep scenes loaded and render the requests\n");
+    printf("                             of clients, address is host:port or unix:path\n");
+    printf("  --server-megabytes <n>     memory of the scenes a server keeps loaded\n");
+    printf("  --client <address>         render on the server at address, the image\n");
+    printf("                             is written to --output\n");
+    printf("  --stop-server              with --client, stop the server\n");
+    printf("  --interactive <n>          benchmark n camera moves while rendering\n");
+    printf("                             1 spp passes\n");
+    printf("  --camera-path <file>       render a sequence along the keyframes in\n");
+    printf("                             file, a \"px py pz tx ty tz\" pose per line\n");
+    printf("  --frames <n>               frames of the camera path sequence\n");
+    printf("  --turntable <n>            render n frames circling the scene\n");
+    printf("  --integrator <name>        path, direct, ao, normals, headlight,\n");
+    printf("                             wavefront\n");
+    printf("  --max-depth <n>            maximum path length\n");
+    printf("  --ao-distance <d>          ambient occlusion ray length\n");
+    printf("  --no-mis                   sample direct lighting from lights only\n");
+    printf("  --light-samples <n>        light samples per shading point, 1 to 16\n");
+    printf("  --radiance-cache           end path tracer paths in a radiance cache\n");
+    printf("  --cache-cell-size <d>      radiance cache cell size\n");
+    printf("  --cache-min-samples <n>    records a cache cell needs before use\n");
+    printf("  --cache-megabytes <n>      radiance cache memory limit\n");
+    printf("  --caustics                 path tracer caustics from photon maps\n");
+    printf("  --caustic-photons <n>      photons emitted per pass\n");
+    printf("  --caustic-radius <r>       photon lookup radius of the first pass\n");
+    printf("  --caustic-alpha <a>        radius reduction per pass, 0 to 1\n");
+    printf("  --guiding                  guide path tracer bounces, trains over\n");
+    printf("                             the first passes (see --pass-spp)\n");
+    printf("  --guiding-iterations <n>   training iterations, each twice as long\n");
+    printf("  --guiding-fraction <f>     share of guided bounces, 0 to 1\n");
+    printf("  --guiding-megabytes <n>    guiding tree memory limit\n");
+    printf("  --batch-size <n>           paths per batch of the wavefront integrator\n");
+    printf("  --ray-bins <n>             sort wavefront secondary rays in runs of n\n");
+    printf("  --light-sampling <mode>    uniform, power, bvh\n");
+    printf("  --sampler <name>           independent, stratified, halton, sobol\n");
+}
+
+static bool parseOptions(int argc, const char* argv[], Options* options)
+{
+    for (int i = 1; i < argc; ++i) {
+        auto arg = argv[i];
+        auto hasValues = [&](int count) { return i + count < argc; };
+
+        if (std::strcmp(arg, "--scene") == 0 && hasValues(1)) {
+            options->sceneName = argv[++i];
+        } else if (std::strcmp(arg, "--obj") == 0 && hasValues(2)) {
+            options->sceneName = "obj";
+            options->objFolder = argv[++i];
+            options->objFile = argv[++i];
+        } else if (std::strcmp(arg, "--width") == 0 && hasValues(1)) {
+            options->width = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--height") == 0 && hasValues(1)) {
+            options->height = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--camera") == 0 && hasValues(6)) {
+            float values[6];
+            for (auto& value : values) {
+                value = (float)std::atof(argv[++i]);
+            }
+            options->customCamera = true;
+            options->cameraPosition = Vector3f(values[0], values[1], values[2]);
+            options->cameraTarget = Vector3f(values[3], values[4], values[5]);
+        } else if (std::strcmp(arg, "--tile-order") == 0 && hasValues(1)) {
+            if (!parseTileOrder(argv[++i], &options->tileOrder)) {
+                printf("Unknown tile order: %s\n", argv[i]);
+                return false;
+            }
+        } else if (std::strcmp(arg, "--output") == 0 && hasValues(1)) {
+            options->output = argv[++i];
+        } else if (std::strcmp(arg, "--spp") == 0 && hasValues(1)) {
+            options->settings.samplesPerPixel = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--pass-spp") == 0 && hasValues(1)) {
+            options->settings.samplesPerPass = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--max-passes") == 0 && hasValues(1)) {
+            options->settings.maxPasses = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--target-error") == 0 && hasValues(1)) {
+            options->settings.targetError = (float)std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--save-passes") == 0) {
+            options->savePasses = true;
+        } else if (std::strcmp(arg, "--adaptive") == 0 && hasValues(1)) {
+            options->settings.adaptiveError = (float)std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--min-spp") == 0 && hasValues(1)) {
+            options->settings.minSamples = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--max-spp") == 0 && hasValues(1)) {
+            options->settings.maxSamples = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--sample-map") == 0 && hasValues(1)) {
+            options->sampleMap = argv[++i];
+        } else if (std::strcmp(arg, "--denoise") == 0) {
+            options->denoise = true;
+        } else if (std::strcmp(arg, "--denoise-iterations") == 0 && hasValues(1)) {
+            options->denoiseSettings.iterations = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--albedo") == 0 && hasValues(1)) {
+            options->albedoOutput = argv[++i];
+        } else if (std::strcmp(arg, "--normals") == 0 && hasValues(1)) {
+            options->normalsOutput = argv[++i];
+        } else if (std::strcmp(arg, "--time") == 0 && hasValues(1)) {
+            options->settings.timeBudget = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--preview") == 0 && hasValues(1)) {
+            options->preview = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--checkpoint") == 0 && hasValues(1)) {
+            options->checkpoint = argv[++i];
+        } else if (std::strcmp(arg, "--checkpoint-interval") == 0 && hasValues(1)) {
+            options->checkpointInterval = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--resume") == 0 && hasValues(1)) {
+            options->resume = argv[++i];
+        } else if (std::strcmp(arg, "--coordinator") == 0 && hasValues(1)) {
+            options->coordinator = argv[++i];
+        } else if (std::strcmp(arg, "--worker") == 0 && hasValues(1)) {
+            options->worker = argv[++i];
+        } else if (std::strcmp(arg, "--worker-timeout") == 0 && hasValues(1)) {
+            options->workerTimeout = std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--sample-range") == 0 && hasValues(2)) {
+            options->sampleBegin = std::atoi(argv[++i]);
+            options->sampleEnd = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--partial") == 0 && hasValues(1)) {
+            options->partial = argv[++i];
+        } else if (std::strcmp(arg, "--merge") == 0 && hasValues(1)) {
+            while (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0) {
+                options->merge.push_back(argv[++i]);
+            }
+        } else if (std::strcmp(arg, "--server") == 0 && hasValues(1)) {
+            options->server = argv[++i];
+        } else if (std::strcmp(arg, "--server-megabytes") == 0 && hasValues(1)) {
+            options->serverMegabytes = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(arg, "--client") == 0 && hasValues(1)) {
+            options->client = argv[++i];
+        } else if (std::strcmp(arg, "--stop-server") == 0) {
+            options->stopServer = true;
+        } else if (std::strcmp(arg, "--interactive") == 0 && hasValues(1)) {
+            options->interactiveMoves = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(arg, "--camera-path") == 0 && hasValues(1)) {
+            options->cameraPath = argv[++i];
+        } else if (std::strcmp(arg, "--frames") == 0 && hasValues(1)) {
+            options->frames = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(arg, "--turntable") == 0 && hasValues(1)) {
+            options->turntableFrames = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(arg, "--integrator") == 0 && hasValues(1)) {
+            if (!parseIntegrator(argv[++i], &options->settings.integrator.type)) {
+                printf("Unknown integrator: %s\n", argv[i]);
+                return false;
+            }
+        } else if (std::strcmp(arg, "--max-depth") == 0 && hasValues(1)) {
+            options->settings.integrator.maxDepth = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--ao-distance") == 0 && hasValues(1)) {
+            options->settings.integrator.aoDistance = (float)std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--no-mis") == 0) {
+            options->settings.integrator.mis = false;
+        } else if (std::strcmp(arg, "--light-samples") == 0 && hasValues(1)) {
+            options->settings.integrator.lightSamples = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--radiance-cache") == 0) {
+            options->settings.integrator.radianceCache = true;
+        } else if (std::strcmp(arg, "--cache-cell-size") == 0 && hasValues(1)) {
+            options->settings.integrator.cacheCellSize = (float)std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--cache-min-samples") == 0 && hasValues(1)) {
+            options->settings.integrator.cacheMinSamples = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--cache-megabytes") == 0 && hasValues(1)) {
+            options->settings.integrator.cacheMegabytes = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--caustics") == 0) {
+            options->settings.integrator.caustics = true;
+        } else if (std::strcmp(arg, "--caustic-photons") == 0 && hasValues(1)) {
+            options->settings.integrator.causticPhotons = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--caustic-radius") == 0 && hasValues(1)) {
+            options->settings.integrator.causticRadius = (float)std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--caustic-alpha") == 0 && hasValues(1)) {
+            options->settings.integrator.causticAlpha = (float)std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--guiding") == 0) {
+            options->settings.integrator.guiding = true;
+        } else if (std::strcmp(arg, "--guiding-iterations") == 0 && hasValues(1)) {
+            options->settings.integrator.guidingIterations = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--guiding-fraction") == 0 && hasValues(1)) {
+            options->settings.integrator.guidingFraction = (float)std::atof(argv[++i]);
+        } else if (std::strcmp(arg, "--guiding-megabytes") == 0 && hasValues(1)) {
+            options->settings.integrator.guidingMegabytes = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--batch-size") == 0 && hasValues(1)) {
+            options->settings.integrator.batchSize = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(arg, "--ray-bins") == 0 && hasValues(1)) {
+            options->settings.integrator.rayBinSize = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(arg, "--sampler") == 0 && hasValues(1)) {
+            if (!parseSampler(argv[++i], &options->settings.sampler)) {
+                printf("Unknown sampler: %s\n", argv[i]);
+                return false;
+            }
+        } else if (std::strcmp(arg, "--light-sampling") == 0 && hasValues(1)) {
+            if (!parseLightSampling(argv[++i], &options->lightSampling)) {
+                printf("Unknown light sampling: %s\n", argv[i]);
+                return false;
+            }
+        } else {
+            printf("Unknown option: %s\n", arg);
+            return false;
+        }
+    }
+
+    if (options->sceneName != "cornell" && options->sceneName != "obj") {
+        printf("Unknown scene: %s\n", options->sceneName.c_str());
+        return false;
+    }
+
+    if (options->width <= 0 || options->height <= 0) {
+        printf("Invalid resolution: %dx%d\n", options->width, options->height);
+        return false;
+    }
+
+    if (options->settings.samplesPerPixel <= 0
+        || options->settings.samplesPerPass <= 0) {
+        printf("Invalid sample count\n");
+        return false;
+    }
+
+    // Only the path tracer reads these, other integrators would ignore them
+    const auto& integrator = options->settings.integrator;
+    if (integrator.type != IntegratorType::PathTracer
+        && (integrator.radianceCache || integrator.caustics
+            || integrator.guiding)) {
+        printf("--radiance-cache, --caustics and --guiding need --integrator "
+            "path\n");
+        return false;
+    }
+
+    // Samplers like the stratified one lay out samplesPerPixel samples, the
+    // range has to be part of them
+    if (options->sampleEnd != 0 && (options->sampleBegin < 0
+        || options->sampleBegin >= options->sampleEnd
+        || options->sampleEnd > options->settings.samplesPerPixel)) {
+        printf("Invalid sample range, it has to be within --spp\n");
+        return false;
+    }
+
+    if (options->customCamera
+        && length2(options->cameraTarget - options->cameraPosition) == 0.0f) {
+        printf("Invalid camera, the look at point is the camera position\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Inserts suffix before the extension of an output name
+static std::string outputWithSuffix(const std::string& output,
+    const std::string& suffix)
+{
+    auto dot = output.find_last_of('.');
+    if (dot == std::string::npos)
+        return output + suffix;
+    return output.substr(0, dot) + suffix + output.substr(dot);
+}
+
+// Output name of a preview frame, the integrator name is inserted before the
+// extension
+static std::string previewOutput(const std::string& output, IntegratorType type)
+{
+    return outputWithSuffix(output, std::string("_") + integratorName(type));
+}
+
+// Renders a frame of each preview integrator within the time budget. The
+// scene is built once, only the renderer settings and the sensor change
+// between frames.
+static void renderPreviews(const Options& options, Renderer* renderer,
+    const Scene& scene, Camera* camera)
+{
+    static const IntegratorType previewTypes[] = {
+        IntegratorType::Headlight,
+        IntegratorType::DirectLighting,
+        IntegratorType::AmbientOcclusion,
+    };
+
+    for (auto type : previewTypes) {
+        auto settings = options.settings;
+        settings.integrator.type = type;
+        settings.timeBudget = options.preview;
+        renderer->setSettings(settings);
+
+        camera->getSensor().clear();
+        renderer->render(scene, *camera);
+
+        const auto& stats = renderer->getStats();
+        printf("Preview %-10s %.3fs, %.1f spp (minimum %u), %.2f Mrays/s\n",
+            integratorName(type), stats.seconds, stats.samplesPerPixel,
+            stats.minSamplesPerPixel, stats.raysPerSecond * 1e-6);
+        camera->saveImage(previewOutput(options.output, type));
+    }
+}
+
+// The image of the sensor, denoised if the options ask for it
+static Bitmap developImage(const Options& options, const Sensor& sensor)
+{
+    auto width = sensor.getWidth();
+    auto height = sensor.getHeight();
+    Bitmap bitmap(width, height);
+
+    if (options.denoise) {
+        Timer denoiseTimer;
+        denoiseTimer.start();
+        std::vector<Spectrum> image;
+        denoise(sensor, options.denoiseSettings, &image);
+        auto denoiseSeconds = denoiseTimer.elapsed().count() * 1e-9;
+        printf("Denoise time:     %.3fs\n", denoiseSeconds);
+
+        for (int32_t y = 0; y < height; ++y) {
+            for (int32_t x = 0; x < width; ++x) {
+                bitmap.set(x, y, image[y * width + x].toRGB());
+            }
+        }
+    } else {
+        sensor.develop(&bitmap);
+    }
+    return bitmap;
+}
+
+// Headless benchmark of interactive rendering. The camera pans back and forth
+// by a little once the view has shown a few frames, which cancels the pass in
+// flight. The time from a move to the first frame of the new view is what a
+// user waits for.
+static void runInteractiveBenchmark(const Options& options, const Scene& scene,
+    Camera* camera)
+{
+    using Seconds = std::chrono::duration<double>;
+
+    auto settings = options.settings;
+    settings.samplesPerPass = 1;
+    auto framesPerView = std::min(4, std::max(1, settings.samplesPerPixel));
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    // View of the last frame, the frames it had so far and the time of its
+    // first one
+    uint64_t frameView = 0;
+    int32_t viewFrames = 0;
+    Timer::Timepoint firstFrame;
+    uint64_t frames = 0;
+    // Last view done rendering. Pass, time and error limits can end a view
+    // before it has framesPerView frames.
+    auto doneView = std::numeric_limits<uint64_t>::max();
+
+    InteractiveSession session(scene, *camera, settings, options.tileOrder);
+    session.start([&](const RenderStats&, const Camera&, uint64_t view) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (view != frameView) {
+            frameView = view;
+            viewFrames = 0;
+            firstFrame = Timer::Clock::now();
+        }
+        viewFrames += 1;
+        frames += 1;
+        condition.notify_all();
+    }, [&](uint64_t view) {
+        std::unique_lock<std::mutex> lock(mutex);
+        doneView = view;
+        condition.notify_all();
+    });
+
+    const auto& bounds = scene.getBounds();
+    auto extent = length(bounds.max - bounds.min);
+    auto position = camera->getPosition();
+    auto direction = camera->getDirection();
+    uint64_t view = 0;
+    std::vector<double> latencies;
+    for (int32_t i = 1; i <= options.interactiveMoves; ++i) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&]() {
+                return (frameView == view && viewFrames >= framesPerView)
+                    || doneView == view;
+            });
+        }
+
+        auto offset = 0.01f * extent * std::sin(0.5f * (float)i);
+        auto moveTime = Timer::Clock::now();
+        view = session.setView(position + Vector3f(offset, 0.0f, 0.0f),
+            direction);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&]() {
+            return frameView == view || doneView == view;
+        });
+        if (frameView == view)
+            latencies.push_back(Seconds(firstFrame - moveTime).count());
+    }
+    session.stop();
+
+    printf("Camera moves:     %d (%llu frames of 1 spp)\n",
+        options.interactiveMoves, (unsigned long long)frames);
+    if (!latencies.empty()) {
+        auto sorted = latencies;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (auto latency : latencies) {
+            sum += latency;
+        }
+        printf("First new frame:  median %.1fms, mean %.1fms, max %.1fms\n",
+            sorted[sorted.size() / 2] * 1e3, sum / latencies.size() * 1e3,
+            sorted.back() * 1e3);
+    }
+}
+
+// Writes the image and the feature images the options ask for. With a
+// writer, the images are developed here and encoded and written by the
+// writer thread.
+static void writeOutputs(const Options& options, const Sensor& sensor,
+    ImageWriter* writer = nullptr)
+{
+    auto width = sensor.getWidth();
+    auto height = sensor.getHeight();
+
+    auto save = [writer](Bitmap bitmap, const std::string& name,
+        bool toneMapped) {
+        if (writer)
+            writer->submit(name, std::move(bitmap), toneMapped);
+        else
+            bitmap.write(name, toneMapped);
+    };
+
+    save(developImage(options, sensor), options.output, true);
+
+    if (!options.albedoOutput.empty()) {
+        Bitmap albedo(width, height);
+        sensor.developAlbedo(&albedo);
+        save(std::move(albedo), options.albedoOutput, false);
+    }
+
+    if (!options.normalsOutput.empty()) {
+        Bitmap normals(width, height);
+        sensor.developNormals(&normals);
+        save(std::move(normals), options.normalsOutput, false);
+    }
+
+    if (!options.sampleMap.empty()) {
+        Bitmap sampleMap(width, height);
+        sensor.developSampleCounts(&sampleMap);
+        save(std::move(sampleMap), options.sampleMap, false);
+    }
+}
+
+// Renders a frame per pose of the camera path or turntable, with the scene
+// loaded and its BVH built once. Frame n is encoded and written while frame
+// n + 1 renders. Outputs get the frame number inserted before the extension.
+static bool renderSequence(const Options& options, Renderer* renderer,
+    const Scene& scene, Camera* camera)
+{
+    using Seconds = std::chrono::duration<double>;
+
+    if (!options.checkpoint.empty() || !options.resume.empty()
+        || !options.partial.empty() || options.sampleEnd > 0
+        || options.preview > 0.0 || options.savePasses) {
+        printf("Sequences render whole frames, without checkpoints, sample "
+            "ranges, previews or pass images\n");
+        return false;
+    }
+
+    std::vector<CameraPose> poses;
+    if (!options.cameraPath.empty()) {
+        std::vector<CameraPose> keyframes;
+        if (!readCameraPath(options.cameraPath, &keyframes))
+            return false;
+        poses = sampleCameraPath(keyframes, options.frames > 0
+            ? options.frames : (int32_t)keyframes.size());
+    } else {
+        const auto& bounds = scene.getBounds();
+        poses = turntablePath(camera->getPosition(),
+            (bounds.min + bounds.max) * 0.5f, options.turntableFrames);
+    }
+
+    ImageWriter writer;
+    auto start = Timer::Clock::now();
+    double renderSeconds = 0.0;
+    for (size_t frame = 0; frame < poses.size(); ++frame) {
+        const auto& pose = poses[frame];
+        camera->setView(pose.position, normal(pose.target - pose.position));
+        camera->getSensor().clear();
+        renderer->render(scene, *camera);
+
+        const auto& stats = renderer->getStats();
+        renderSeconds += stats.seconds;
+        printf("Frame %zu:         %.3fs, %.1f spp, %.2f Mrays/s\n", frame,
+            stats.seconds, stats.samplesPerPixel, stats.raysPerSecond * 1e-6);
+
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), "_%04zu", frame);
+        auto frameOptions = options;
+        frameOptions.output = outputWithSuffix(options.output, suffix);
+        if (!options.albedoOutput.empty())
+            frameOptions.albedoOutput = outputWithSuffix(options.albedoOutput, suffix);
+        if (!options.normalsOutput.empty())
+            frameOptions.normalsOutput = outputWithSuffix(options.normalsOutput, suffix);
+        if (!options.sampleMap.empty())
+            frameOptions.sampleMap = outputWithSuffix(options.sampleMap, suffix);
+        writeOutputs(frameOptions, camera->getSensor(), &writer);
+    }
+
+    auto success = writer.flush();
+    printf("Sequence:         %zu frames in %.3fs, %.3fs of it rendering\n",
+        poses.size(), Seconds(Timer::Clock::now() - start).count(),
+        renderSeconds);
+    return success;
+}
+
+// Scene of the options, still to be preprocessed
+static Scene makeScene(const Options& options)
+{
+    return options.sceneName == "cornell"
+        ? Scene::makeCornellBox()
+        : Scene::loadFromObj(options.objFolder, options.objFile);
+}
+
+static Camera makeCamera(const Options& options)
+{
+    if (options.customCamera) {
+        return Camera(
+            options.cameraPosition,
+            normal(options.cameraTarget - options.cameraPosition),
+            options.width,
+            options.height,
+            0.785398f);
+    }
+
+    return options.sceneName == "cornell"
+        ? Camera(
+            Vector3f(50.0f, 48.0f, 220.0f),
+            normal(Vector3f(0.0f, -0.042612f, -1.0f)),
+            options.width,
+            options.height,
+            0.785398f)
+        : Camera(
+            Vector3f(0.0f, 0.85f, 3.0f),
+            normal(Vector3f(0.0f, 0.0f, -1.0f)),
+            options.width,
+            options.height,
+            0.785398f);
+}
+
+// Distributed and sample range renders take the same samples of every pixel
+// wherever they run, which rules out anything that decides on samples as it
+// goes
+static bool fixedSampleCount(const Options& options, const char* mode)
+{
+    const auto& settings = options.settings;
+    const auto& integrator = settings.integrator;
+    if (settings.adaptiveError > 0.0f || settings.targetError > 0.0f
+        || settings.timeBudget > 0.0 || settings.maxPasses > 0
+        || integrator.radianceCache || integrator.caustics
+        || integrator.guiding || options.preview > 0.0
+        || !options.resume.empty() || !options.checkpoint.empty()) {
+        printf("%s take a fixed number of samples per pixel, without adaptive "
+            "sampling, stopping criteria, learned integrator state, previews "
+            "or checkpoints\n", mode);
+        return false;
+    }
+    return true;
+}
+
+// Hands the frame out to worker processes. Workers get the command line
+// without the coordinator options and parse it like rt does.
+static bool renderDistributed(const Options& options, int argc,
+    const char* argv[], Camera* camera)
+{
+    if (!fixedSampleCount(options, "Distributed renders"))
+        return false;
+
+    std::vector<std::string> arguments;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--coordinator") == 0
+            || std::strcmp(argv[i], "--worker-timeout") == 0) {
+            ++i;
+            continue;
+        }
+        arguments.push_back(argv[i]);
+    }
+
+    Coordinator coordinator(arguments, options.workerTimeout);
+    if (!coordinator.listen(options.coordinator))
+        return false;
+
+    printf("Waiting for workers at %s\n", options.coordinator.c_str());
+    coordinator.render(options.settings, *camera);
+
+    const auto& stats = coordinator.getStats();
+    printf("Frame time:       %.3fs\n", stats.seconds);
+    printf("Workers:          %d\n", stats.workers);
+    printf("Jobs:             %lld (%lld lost, %lld backup copies)\n",
+        (long long)stats.jobs, (long long)stats.lostJobs,
+        (long long)stats.backupJobs);
+    return true;
+}
+
+// Renders the jobs of a coordinator until its frame is done
+static int runWorker(const Options& options)
+{
+    DistributedWorker worker;
+    std::vector<std::string> arguments;
+    if (!worker.connect(options.worker, &arguments))
+        return 1;
+
+    std::vector<const char*> argv = { "rt" };
+    for (const auto& argument : arguments) {
+        argv.push_back(argument.c_str());
+    }
+
+    Options renderOptions;
+    if (!parseOptions((int)argv.size(), argv.data(), &renderOptions))
+        return 1;
+
+    workQueueInit();
+
+	auto scene = makeScene(renderOptions);
+    scene.setLightSampling(renderOptions.lightSampling);
+	scene.preprocess();
+    auto camera = makeCamera(renderOptions);
+
+    Renderer renderer;
+    renderer.setTileOrder(renderOptions.tileOrder);
+    renderer.setSettings(renderOptions.settings);
+
+    auto success = worker.serve(renderer, scene, camera);
+    printf("%s after %lld jobs\n", success ? "Frame done" : "Connection lost",
+        (long long)worker.jobCount());
+
+    workQueueShutdown();
+    return success ? 0 : 1;
+}
+
+// Renders a range of samples of every pixel in a single pass
+static bool renderSampleRange(const Options& options, Renderer* renderer,
+    const Scene& scene, Camera* camera)
+{
+    if (!fixedSampleCount(options, "Sample range renders"))
+        return false;
+
+    Tile image(Vector2i(0, 0), camera->getResolution(), Vector2i(0, 0));
+    renderer->renderRegion(scene, *camera, image, options.sampleBegin,
+        options.sampleEnd);
+
+    printf("Samples %d to %d of %d per pixel\n", options.sampleBegin,
+        options.sampleEnd - 1, options.settings.samplesPerPixel);
+    printRenderStats(renderer->getStats());
+
+    return options.partial.empty() || writeCheckpoint(options.partial,
+        checkpointInfo(options.settings, camera->getSensor(), 1,
+            options.sampleBegin), camera->getSensor());
+}
+
+// Adds up partial renders in the order of their sample ranges, which is the
+// order a single render takes the samples in. Ranges of a pixel may leave
+// gaps, but must not overlap, overlapping samples are the same samples.
+static int mergePartials(const Options& options)
 {
+    std::vector<std::pair<CheckpointInfo, std::string>> partials;
+    for (const auto& name : options.merge) {
+        CheckpointInfo info;
+        if (!readCheckpointInfo(name, &info))
+            return 1;
+
+        const auto& first = partials.empty() ? info : partials[0].first;
+        if (info.width != first.width || info.height != first.height
+            || info.integrator != first.integrator
+            || info.sampler != first.sampler
+            || info.samplesPerPixel != first.samplesPerPixel) {
+            printf("%s was rendered with different settings than %s\n",
+                name.c_str(), partials[0].second.c_str());
+            return 1;
+        }
+        partials.emplace_back(info, name);
+    }
+
+    std::stable_sort(partials.begin(), partials.end(),
+        [](const std::pair<CheckpointInfo, std::string>& lhs,
+            const std::pair<CheckpointInfo, std::string>& rhs) {
+            return lhs.first.firstSample < rhs.first.firstSample;
+        });
+
+    auto info = partials[0].first;
+    auto width = info.width;
+    auto height = info.height;
+    Sensor merged(width, height);
+    Sensor partial(width, height);
+    // First sample index of every pixel that no partial has taken yet, -1
+    // before the first partial with samples of the pixel
+    std::vector<int64_t> nextSample((size_t)width * height, -1);
+    // A partial render holds a single range of samples per pixel, starting
+    // at info.firstSample. Merges that skip samples can only be developed.
+    std::string gap;
+    for (const auto& entry : partials) {
+        CheckpointInfo partialInfo;
+        if (!readCheckpoint(entry.second, &partialInfo, &partial))
+            return 1;
+
+        for (int32_t y = 0; y < height; ++y) {
+            for (int32_t x = 0; x < width; ++x) {
+                auto pixel = partial.takePixel(x, y);
+                if (pixel.count == 0)
+                    continue;
+
+                auto& next = nextSample[y * width + x];
+                if (partialInfo.firstSample < next) {
+                    printf("%s overlaps the samples of another partial render "
+                        "at pixel %d, %d\n", entry.second.c_str(), x, y);
+                    return 1;
+                }
+                auto expected = next < 0 ? (int64_t)info.firstSample : next;
+                if (gap.empty() && partialInfo.firstSample > expected) {
+                    char buffer[128];
+                    snprintf(buffer, sizeof(buffer),
+                        "samples %lld to %lld of pixel %d, %d",
+                        (long long)expected,
+                        (long long)partialInfo.firstSample - 1, x, y);
+                    gap = buffer;
+                }
+                next = (int64_t)partialInfo.firstSample + pixel.count;
+                merged.addPixel(x, y, pixel);
+            }
+        }
+    }
+
+    printf("Merged %d partial renders, %.1f spp\n", (int32_t)partials.size(),
+        (double)merged.totalSamples() / ((double)width * height));
+    if (!gap.empty() && !options.partial.empty()) {
+        printf("The partial renders miss %s, the merge can't be written as a "
+            "partial render\n", gap.c_str());
+        return 1;
+    }
+
+    workQueueInit();
+    writeOutputs(options, merged);
+    auto success = options.partial.empty()
+        || writeCheckpoint(options.partial, info, merged);
+    workQueueShutdown();
+    return success ? 0 : 1;
+}
+
+// Renders a request of a client on a scene of the cache. Requests pick the
+// scene, camera, resolution and render settings, everything that writes files
+// or outlives a single frame is up to the client.
+static bool serveRender(const std::vector<std::string>& arguments,
+    SceneCache* cache, std::string* log, std::vector<char>* image)
+{
+    std::vector<const char*> argv = { "rt" };
+    for (const auto& argument : arguments) {
+        argv.push_back(argument.c_str());
+    }
+
+    Options options;
+    if (!parseOptions((int)argv.size(), argv.data(), &options)) {
+        *log = "Invalid render arguments, see the server output";
+        return false;
+    }
+
+    if (!options.server.empty() || !options.client.empty()
+        || !options.coordinator.empty() || !options.worker.empty()
+        || !options.merge.empty() || !options.resume.empty()
+        || !options.checkpoint.empty() || !options.partial.empty()
+        || options.sampleEnd > 0 || options.preview > 0.0
+        || options.savePasses || !options.albedoOutput.empty()
+        || !options.normalsOutput.empty() || !options.sampleMap.empty()
+        || options.interactiveMoves > 0 || !options.cameraPath.empty()
+        || options.turntableFrames > 0) {
+        *log = "Server renders take a single frame and return only its "
+            "image, without distribution, sample ranges, checkpoints, "
+            "previews, pass images, albedo, normal or sample map images, "
+            "interactive benchmarks or sequences";
+        return false;
+    }
+
+    // Light sampling structures are built by preprocess
+    auto key = options.sceneName == "cornell" ? options.sceneName
+        : options.sceneName + ":" + options.objFolder + options.objFile;
+    key += std::string(":") + lightSamplingName(options.lightSampling);
+
+    Timer loadTimer;
+    loadTimer.start();
+    bool loaded = false;
+    const auto* scene = cache->get(key, [&options]() {
+        auto scene = std::make_unique<Scene>(makeScene(options));
+        scene->setLightSampling(options.lightSampling);
+        scene->preprocess();
+        return scene;
+    }, &loaded);
+    auto loadSeconds = loadTimer.elapsed().count() * 1e-9;
+    if (!scene) {
+        *log = "Can't load scene " + key;
+        return false;
+    }
+
+    Renderer renderer;
+    renderer.setTileOrder(options.tileOrder);
+    renderer.setSettings(options.settings);
+    auto camera = makeCamera(options);
+    renderer.render(*scene, camera);
+    developImage(options, camera.getSensor()).encode(image);
+
+    const auto& stats = renderer.getStats();
+    const auto& cacheStats = cache->getStats();
+    char text[512];
+    std::snprintf(text, sizeof(text),
+        "Scene %s %s in %.3fs, %.1f MB resident\n"
+        "Rendered %dx%d, %s, %.1f spp in %.3fs, %.2f Mrays/s\n",
+        key.c_str(), loaded ? "loaded" : "resident", loadSeconds,
+        cacheStats.bytes / (1024.0 * 1024.0), options.width, options.height,
+        integratorName(options.settings.integrator.type),
+        stats.samplesPerPixel, stats.seconds, stats.raysPerSecond * 1e-6);
+    *log = text;
+    printf("%s", text);
+    return true;
+}
+
+// Keeps the scenes of earlier requests loaded and preprocessed, so that a
+// request for a resident scene starts rendering right away
+static int runServer(const Options& options)
+{
+    RenderServer server;
+    if (!server.listen(options.server))
+        return 1;
+
+    workQueueInit();
+
+    SceneCache cache((size_t)options.serverMegabytes * 1024 * 1024);
+    printf("Serving renders at %s\n", options.server.c_str());
+    server.serve([&cache](const std::vector<std::string>& arguments,
+        std::string* log, std::vector<char>* image) {
+        return serveRender(arguments, &cache, log, image);
+    });
+
+    const auto& stats = cache.getStats();
+    printf("Scene cache: %lld hits, %lld loads, %lld evictions\n",
+        (long long)stats.hits, (long long)stats.loads,
+        (long long)stats.evictions);
+
+    workQueueShutdown();
+    return 0;
+}
+
+// Sends the command line, without the client options and the output, to a
+// server and writes the image it answers with
+static int runClient(const Options& options, int argc, const char* argv[])
+{
+    if (options.stopServer)
+        return requestStop(options.client) ? 0 : 1;
+
+    std::vector<std::string> arguments;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--client") == 0
+            || std::strcmp(argv[i], "--output") == 0) {
+            ++i;
+            continue;
+        }
+        arguments.push_back(argv[i]);
+    }
+
+    std::string log;
+    std::vector<char> image;
+    auto success = requestRender(options.client, arguments, &log, &image);
+    printf("%s%s", log.c_str(),
+        !log.empty() && log.back() != '\n' ? "\n" : "");
+    if (!success)
+        return 1;
+
+    std::ofstream out(options.output, std::ios::out | std::ios::binary);
+    out.write(image.data(), image.size());
+    return out ? 0 : 1;
+}
+
+int main(int argc, const char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (!options.worker.empty()) {
+        return runWorker(options);
+    }
+
+    if (!options.merge.empty()) {
+        return mergePartials(options);
+    }
+
+    if (!options.server.empty()) {
+        return runServer(options);
+    }
+
+    if (!options.client.empty()) {
+        return runClient(options, argc, argv);
+    }
+
 	Renderer renderer;
+    renderer.setTileOrder(options.tileOrder);
+    renderer.setSettings(options.settings);
 
     workQueueInit();
 
-    auto width = 1024;
-    auto height = 768;
-
-#if 0
-	auto scene = Scene::makeCornellBox();
-	auto camera = Camera(
-		Vector3f(50.0f, 48.0f, 220.0f),
-		normal(Vector3f(0.0f, -0.042612f, -1.0f)),
-		width,
-		height,
-		0.785398f
-	);
+    auto width = options.width;
+    auto height = options.height;
+
+	auto camera = makeCamera(options);
+
+    if (!options.coordinator.empty()) {
+        auto success = renderDistributed(options, argc, argv, &camera);
+        if (success)
+            writeOutputs(options, camera.getSensor());
+        workQueueShutdown();
+        return success ? 0 : 1;
+    }
+
+	auto scene = makeScene(options);
+    scene.setLightSampling(options.lightSampling);
 	scene.preprocess();
-#else
-#if 1 
-	auto scene = Scene::loadFromObj(
-        "/Users/marcin/projects/rt/scenes/cornell-box/",
-        "CornellBox-Mirror.obj");
-#else
-	auto scene = Scene::loadFromObj(
-        "/Users/marcin/projects/rt/scenes/sibenik/",
-        "sibenik.obj");
-#endif
-    scene.preprocess();
-	auto camera = Camera(
-		Vector3f(0.0f, 0.85f, 3.0f),
-		normal(Vector3f(0.0f, 0.0f, -1.0f)),
-		width,
-		height,
-		0.785398f
-	);
-#endif
+
+    if (options.preview > 0.0) {
+        renderPreviews(options, &renderer, scene, &camera);
+        workQueueShutdown();
+        return 0;
+    }
+
+    if (!options.cameraPath.empty() || options.turntableFrames > 0) {
+        auto success = renderSequence(options, &renderer, scene, &camera);
+        workQueueShutdown();
+        return success ? 0 : 1;
+    }
+
+    if (options.interactiveMoves > 0) {
+        runInteractiveBenchmark(options, scene, &camera);
+        writeOutputs(options, camera.getSensor());
+        workQueueShutdown();
+        return 0;
+    }
+
+    if (options.sampleEnd > 0) {
+        auto success = renderSampleRange(options, &renderer, scene, &camera);
+        if (success)
+            writeOutputs(options, camera.getSensor());
+        workQueueShutdown();
+        return success ? 0 : 1;
+    }
+
+    // Passes rendered by earlier runs of a resumed render
+    int32_t resumedPasses = 0;
+    if (!options.resume.empty()) {
+        CheckpointInfo info;
+        if (!readCheckpoint(options.resume, &info, &camera.getSensor())) {
+            workQueueShutdown();
+            return 1;
+        }
+
+        const auto& settings = options.settings;
+        if (info.integrator != settings.integrator.type
+            || info.sampler != settings.sampler
+            || info.samplesPerPixel != settings.samplesPerPixel) {
+            printf("Checkpoint was rendered with %s, %s sampler, %d spp\n",
+                integratorName(info.integrator), samplerName(info.sampler),
+                info.samplesPerPixel);
+            workQueueShutdown();
+            return 1;
+        }
+
+        if (info.firstSample != 0) {
+            printf("%s is a sample range render, add it up with --merge\n",
+                options.resume.c_str());
+            workQueueShutdown();
+            return 1;
+        }
+
+        resumedPasses = info.passes;
+        printf("Resuming after pass %d, %.1f spp\n", resumedPasses,
+            (double)camera.getSensor().totalSamples() / ((double)width * height));
+        const auto& integrator = settings.integrator;
+        if (integrator.radianceCache || integrator.caustics
+            || integrator.guiding) {
+            printf("Radiance cache, caustic photons and guiding start over, the "
+                "image will differ from an uninterrupted render\n");
+        }
+        if (settings.maxPasses > 0) {
+            auto settingsLeft = settings;
+            settingsLeft.maxPasses = std::max(1, settings.maxPasses - resumedPasses);
+            renderer.setSettings(settingsLeft);
+        }
+    }
+
+    std::unique_ptr<CheckpointWriter> checkpointWriter;
+    if (!options.checkpoint.empty())
+        checkpointWriter = std::make_unique<CheckpointWriter>(options.checkpoint);
+
+    if (options.savePasses || checkpointWriter) {
+        Timer checkpointTimer;
+        checkpointTimer.start();
+        auto* writer = checkpointWriter.get();
+        renderer.setPassCallback([&options, writer, checkpointTimer,
+            resumedPasses](const RenderStats& stats, Camera& cam) mutable {
+            if (options.savePasses) {
+                printf("Pass %d done, %.1f spp, error %.4f\n",
+                    stats.passes, stats.samplesPerPixel, stats.error);
+                cam.saveImage(options.output);
+            }
+
+            if (writer && checkpointTimer.elapsed().count() * 1e-9
+                >= options.checkpointInterval) {
+                writer->submit(checkpointInfo(options.settings,
+                    cam.getSensor(), resumedPasses + stats.passes),
+                    cam.getSensor());
+                checkpointTimer.start();
+            }
+            return true;
+        });
+    }
 
 	Timer timer;
 	timer.start();
 	renderer.render(scene, camera);
 	auto elapsed = timer.elapsed();
 
+    // The final state, so that the render can be continued with more samples
+    if (checkpointWriter) {
+        checkpointWriter->submit(checkpointInfo(options.settings,
+            camera.getSensor(), resumedPasses + renderer.getStats().passes),
+            camera.getSensor());
+        checkpointWriter->flush();
+    }
+
+    auto partialWritten = options.partial.empty()
+        || writeCheckpoint(options.partial, checkpointInfo(options.settings,
+            camera.getSensor(), resumedPasses + renderer.getStats().passes),
+            camera.getSensor());
+
 	auto nanosec = elapsed.count();
 	auto minutes = nanosec / 60000000000;
 
@@ -62,11 +1154,19 @@ int main(int /*argc*/, const char* /*argv*/[])
 	auto milisec = nanosec / 1000000;
 
 	printf("Time spent rendering: %lldm %llds %lldms\n", minutes, seconds, milisec);
+    printf("Tile order: %s\n", tileOrderName(renderer.getTileOrder()));
+    printf("Integrator: %s, sampler: %s\n",
+        integratorName(options.settings.integrator.type),
+        samplerName(options.settings.sampler));
+    printRenderStats(renderer.getStats());
+    if (options.settings.timeBudget > 0.0) {
+        printf("Time budget:      %.3fs (overshoot %.3fs)\n",
+            options.settings.timeBudget, renderer.getStats().overshootSeconds);
+    }
 
-	camera.saveImage("image.bmp");
+    writeOutputs(options, camera.getSensor());
 
 	workQueueShutdown();
 
-	return 0;
+	return partialWritten ? 0 : 1;
 }
-
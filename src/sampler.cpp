@@ -0,0 +1,32 @@
+#include "sampler.h"
+
+#include <cstring>
+
+const char* samplerName(SamplerType type)
+{
+    switch (type) {
+    case SamplerType::Independent:  return "independent";
+    case SamplerType::Stratified:   return "stratified";
+    case SamplerType::Halton:       return "halton";
+    case SamplerType::Sobol:        return "sobol";
+    }
+    return "unknown";
+}
+
+bool parseSampler(const char* name, SamplerType* type)
+{
+    static const SamplerType types[] = {
+        SamplerType::Independent,
+        SamplerType::Stratified,
+        SamplerType::Halton,
+        SamplerType::Sobol,
+    };
+
+    for (auto candidate : types) {
+        if (std::strcmp(name, samplerName(candidate)) == 0) {
+            *type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
@@ -1,6 +1,52 @@
 #include "scene.h"
 #include "tiny_obj_loader.h"
 
+#include <cstring>
+
+const char* lightSamplingName(LightSampling sampling)
+{
+    switch (sampling) {
+    case LightSampling::Uniform:    return "uniform";
+    case LightSampling::Power:      return "power";
+    case LightSampling::Bvh:        return "bvh";
+    }
+    return "unknown";
+}
+
+bool parseLightSampling(const char* name, LightSampling* sampling)
+{
+    static const LightSampling samplings[] = {
+        LightSampling::Uniform,
+        LightSampling::Power,
+        LightSampling::Bvh,
+    };
+
+    for (auto candidate : samplings) {
+        if (std::strcmp(name, lightSamplingName(candidate)) == 0) {
+            *sampling = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scene::buildLightDistribution()
+{
+    std::vector<float> weights;
+    weights.reserve(lights_.size());
+    lightIndices_.clear();
+    for (size_t i = 0; i < lights_.size(); ++i) {
+        // All zero weights give the uniform distribution
+        weights.push_back(lightSampling_ == LightSampling::Power
+            ? lights_[i]->power().y() : 0.0f);
+        lightIndices_[lights_[i].get()] = (int32_t)i;
+    }
+    lightDistribution_.build(weights);
+
+    if (lightSampling_ == LightSampling::Bvh)
+        lightBvh_.build(lights_);
+}
+
 Scene Scene::makeCornellBox()
 {
 	using ShapeList = std::vector<std::shared_ptr<Shape>>;
@@ -147,7 +193,7 @@ Scene Scene::makeCornellBox()
 		),
 		std::make_shared<AreaLight>(
 			shapes[shapes.size() - 1],
-			Spectrum(500.0f, 500.0f, 500.0f)
+			Spectrum(250.0f, 250.0f, 250.0f)
 		),
 	};
 
@@ -286,7 +332,7 @@ Scene Scene::loadFromObj(const std::string& folder, const std::string& file)
 	LightList lights = {
 		std::make_shared<AreaLight>(
 			shps[shps.size() - 1],
-			Spectrum(1.0f, 1.0f, 1.0f)
+			Spectrum(800.0f, 800.0f, 800.0f)
 		),
         //std::make_shared<PointLight>(
         //    Vector3f(0.0f, 1.0f, 0.0f),
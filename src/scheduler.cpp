@@ -1,14 +1,23 @@
 #include "scheduler.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
 #include <thread>
+#include <utility>
 
 #include "semaphore.h"
 
+using Clock = std::chrono::high_resolution_clock;
+using Timepoint = Clock::time_point;
+using Seconds = std::chrono::duration<double>;
+
 std::vector<std::thread> workers;
 
 WorkQueue workQueue;
+// Tasks currently being run by the workers, candidates for splitting
+std::vector<Task*> runningTasks;
 using LockGuard = std::unique_lock<std::mutex>;
 std::mutex queueMutex;
 std::mutex runMutex;
@@ -16,9 +25,71 @@ std::condition_variable runCondition;
 semaphore taskSemahore(0);
 
 size_t numUnfinished = 0;
+bool shuttingDown = false;
+
+// Idle tracking, guarded by runMutex. A worker is idle from the moment it
+// fails to find work, until it picks up a task or all tasks are finished.
+std::vector<Timepoint> idleSince;
+std::vector<bool> isIdle;
+SchedulerStats stats;
 
 static const int32_t numWorkers = 8;
 
+namespace {
+
+void markIdle(int32_t worker)
+{
+    LockGuard lock(runMutex);
+    if (numUnfinished > 0 && !isIdle[worker]) {
+        isIdle[worker] = true;
+        idleSince[worker] = Clock::now();
+    }
+}
+
+void markBusy(int32_t worker)
+{
+    LockGuard lock(runMutex);
+    if (isIdle[worker]) {
+        isIdle[worker] = false;
+        stats.idleSeconds += Seconds(Clock::now() - idleSince[worker]).count();
+    }
+}
+
+// Has to be called with queueMutex held. Splits the running task with the
+// most remaining work.
+std::unique_ptr<Task> stealWork()
+{
+    // The running tasks keep making progress, sort a snapshot of their
+    // remaining work. Sorting on live values breaks the ordering std::sort
+    // relies on and lets it run past the end of the array.
+    std::vector<std::pair<double, Task*>> candidates;
+    candidates.reserve(runningTasks.size());
+    for (auto task : runningTasks) {
+        candidates.emplace_back(task->remaining(), task);
+    }
+    std::sort(begin(candidates), end(candidates),
+        [](const std::pair<double, Task*>& lhs,
+            const std::pair<double, Task*>& rhs) {
+            return lhs.first > rhs.first;
+        });
+
+    for (const auto& candidate : candidates) {
+        auto stolen = candidate.second->split();
+        if (stolen) {
+            // The victim is still running, so numUnfinished can't drop to
+            // zero before the new task is accounted for
+            LockGuard lock(runMutex);
+            ++numUnfinished;
+            ++stats.splits;
+            return stolen;
+        }
+    }
+
+    return nullptr;
+}
+
+} // anonymous namespace
+
 void enqueuTasks(WorkQueue& tasks)
 {
     {
@@ -37,35 +108,71 @@ void enqueuTasks(WorkQueue& tasks)
 void runTasks()
 {
     printf("Running tasks\n");
-    auto size = workQueue.size();
+    // Wake every worker, the ones that don't get a task from the queue will
+    // try to split the running ones
+    auto size = workQueue.empty() ? 0 : numWorkers;
     while (size-- > 0) {
         taskSemahore.post();
     }
 }
 
-void taskEntry()
+void taskEntry(int32_t worker)
 {
     for (;;) {
         taskSemahore.wait();
 
-        std::unique_ptr<Task> currentTile;
-        {
-            LockGuard lock(queueMutex);
-            if (workQueue.size() == 0)
+        // Keep running tasks as long as there is anything to take, either
+        // from the queue or by splitting tasks running on other workers
+        for (;;) {
+            std::unique_ptr<Task> currentTile;
+            {
+                LockGuard lock(queueMutex);
+                if (shuttingDown)
+                    return;
+
+                if (!workQueue.empty()) {
+                    currentTile = std::move(workQueue.back());
+                    workQueue.pop_back();
+                } else {
+                    currentTile = stealWork();
+                }
+
+                if (currentTile)
+                    runningTasks.push_back(currentTile.get());
+            }
+
+            if (!currentTile) {
+                markIdle(worker);
                 break;
-            currentTile = std::move(workQueue.back());
-            workQueue.pop_back();
-        }
+            }
 
-        currentTile->run();
+            markBusy(worker);
+
+            currentTile->run();
+
+            {
+                LockGuard lock(queueMutex);
+                runningTasks.erase(std::find(
+                    begin(runningTasks), end(runningTasks), currentTile.get()));
+            }
+            currentTile.reset();
 
-        {
-            LockGuard lock(runMutex);
-            auto unfinished = --numUnfinished;
-            if (unfinished <= 0)
             {
-                runCondition.notify_one();
-                printf("Tasks finished\n");
+                LockGuard lock(runMutex);
+                auto unfinished = --numUnfinished;
+                if (unfinished <= 0)
+                {
+                    // Frame finished, close the idle periods of other workers
+                    auto now = Clock::now();
+                    for (int32_t i = 0; i < numWorkers; ++i) {
+                        if (isIdle[i]) {
+                            stats.idleSeconds += Seconds(now - idleSince[i]).count();
+                            isIdle[i] = false;
+                        }
+                    }
+                    runCondition.notify_one();
+                    printf("Tasks finished\n");
+                }
             }
         }
     }
@@ -82,9 +189,12 @@ void waitForCompletion()
 void workQueueInit()
 {
     printf("Init work queue\n");
+    shuttingDown = false;
+    idleSince.assign(numWorkers, Timepoint());
+    isIdle.assign(numWorkers, false);
     workers.reserve(numWorkers);
     for (int32_t i = 0; i < numWorkers; ++i) {
-        workers.push_back(std::thread(taskEntry));
+        workers.push_back(std::thread(taskEntry, i));
     }
 }
 
@@ -92,8 +202,30 @@ void workQueueShutdown()
 {
     printf("Shutdown work queue\n");
     waitForCompletion();
+    {
+        LockGuard lock(queueMutex);
+        shuttingDown = true;
+    }
     for (int32_t i = 0; i < numWorkers; ++i) {
         taskSemahore.post();
     }
     std::for_each(begin(workers), end(workers), [&](auto& t){ t.join(); });
+    workers.clear();
+}
+
+int32_t workerCount()
+{
+    return numWorkers;
+}
+
+SchedulerStats schedulerStats()
+{
+    LockGuard lock(runMutex);
+    return stats;
+}
+
+void resetSchedulerStats()
+{
+    LockGuard lock(runMutex);
+    stats = SchedulerStats();
 }
@@ -0,0 +1,158 @@
+#include "sensor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <limits>
+#include <ostream>
+
+// Keeps the relative error of black pixels finite
+static const float errorLumaBias = 1e-2f;
+
+float Sensor::meanVariance(int32_t x, int32_t y) const
+{
+    auto idx = y * width_ + x;
+    auto n = (float)sampleCount_[idx];
+    if (n < 2.0f)
+        return std::numeric_limits<float>::infinity();
+
+    auto mean = sum_[idx].y() / n;
+    auto variance = std::max(0.0f, (lumaSqSum_[idx] / n - mean * mean))
+        * n / (n - 1.0f);
+    return variance / n;
+}
+
+float Sensor::relativeError(int32_t x, int32_t y) const
+{
+    auto idx = y * width_ + x;
+    auto n = (float)sampleCount_[idx];
+    if (n < 2.0f)
+        return std::numeric_limits<float>::infinity();
+
+    auto mean = sum_[idx].y() / n;
+    auto standardError = std::sqrt(meanVariance(x, y));
+
+    return standardError / (std::abs(mean) + errorLumaBias);
+}
+
+float Sensor::averageError() const
+{
+    double error = 0.0;
+    for (int32_t y = 0; y < height_; ++y) {
+        for (int32_t x = 0; x < width_; ++x) {
+            error += relativeError(x, y);
+        }
+    }
+    return (float)(error / ((double)width_ * height_));
+}
+
+uint64_t Sensor::totalSamples() const
+{
+    uint64_t total = 0;
+    for (auto count : sampleCount_) {
+        total += count;
+    }
+    return total;
+}
+
+uint32_t Sensor::minSampleCount() const
+{
+    if (sampleCount_.empty())
+        return 0;
+    return *std::min_element(begin(sampleCount_), end(sampleCount_));
+}
+
+void Sensor::develop(Bitmap* bitmap) const
+{
+    for (int32_t y = 0; y < height_; ++y) {
+        for (int32_t x = 0; x < width_; ++x) {
+            bitmap->set(x, y, value(x, y).toRGB());
+        }
+    }
+}
+
+void Sensor::developAlbedo(Bitmap* bitmap) const
+{
+    for (int32_t y = 0; y < height_; ++y) {
+        for (int32_t x = 0; x < width_; ++x) {
+            bitmap->set(x, y, albedo(x, y).toRGB());
+        }
+    }
+}
+
+void Sensor::developNormals(Bitmap* bitmap) const
+{
+    for (int32_t y = 0; y < height_; ++y) {
+        for (int32_t x = 0; x < width_; ++x) {
+            auto n = normal(x, y);
+            RGBColor color = {
+                0.5f * (n.x + 1.0f),
+                0.5f * (n.y + 1.0f),
+                0.5f * (n.z + 1.0f),
+            };
+            bitmap->set(x, y, color);
+        }
+    }
+}
+
+void Sensor::developSampleCounts(Bitmap* bitmap) const
+{
+    uint32_t maxCount = 1;
+    for (auto count : sampleCount_) {
+        maxCount = std::max(maxCount, count);
+    }
+
+    for (int32_t y = 0; y < height_; ++y) {
+        for (int32_t x = 0; x < width_; ++x) {
+            auto t = (float)sampleCount(x, y) / maxCount;
+            RGBColor color = {
+                std::min(1.0f, 3.0f * t),
+                std::min(1.0f, std::max(0.0f, 3.0f * t - 1.0f)),
+                std::max(0.0f, 3.0f * t - 2.0f),
+            };
+            bitmap->set(x, y, color);
+        }
+    }
+}
+
+namespace {
+
+template <typename T>
+void writeArray(std::ostream& out, const std::vector<T>& values)
+{
+    out.write(reinterpret_cast<const char*>(values.data()),
+        values.size() * sizeof(T));
+}
+
+template <typename T>
+void readArray(std::istream& in, std::vector<T>* values)
+{
+    in.read(reinterpret_cast<char*>(values->data()),
+        values->size() * sizeof(T));
+}
+
+} // anonymous namespace
+
+bool Sensor::write(std::ostream& out) const
+{
+    writeArray(out, sum_);
+    writeArray(out, lumaSqSum_);
+    writeArray(out, sampleCount_);
+    writeArray(out, albedoSum_);
+    writeArray(out, normalSum_);
+    return out.good();
+}
+
+bool Sensor::read(std::istream& in)
+{
+    readArray(in, &sum_);
+    readArray(in, &lumaSqSum_);
+    readArray(in, &sampleCount_);
+    readArray(in, &albedoSum_);
+    readArray(in, &normalSum_);
+    if (in.good())
+        return true;
+
+    clear();
+    return false;
+}
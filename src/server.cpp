@@ -0,0 +1,161 @@
+#include "server.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "scene.h"
+
+namespace {
+
+// Seconds a connected client may stay silent before the server moves on to
+// the next one, requests are served one at a time
+constexpr double clientTimeout = 60.0;
+
+enum MessageType : uint32_t {
+    // Client to server: the arguments of the render, each followed by a null
+    // character
+    RequestMessage = 1,
+    // Client to server: stop serving
+    StopMessage,
+    // Server to client: log text of the render, the image follows
+    LogMessage,
+    // Server to client: the encoded image
+    ImageMessage,
+    // Server to client: why the request failed
+    ErrorMessage,
+};
+
+} // anonymous namespace
+
+SceneCache::SceneCache(size_t maxBytes)
+    : maxBytes_(maxBytes)
+{ }
+
+SceneCache::~SceneCache() = default;
+
+const Scene* SceneCache::get(const std::string& key, const Loader& loader,
+    bool* loaded)
+{
+    if (loaded)
+        *loaded = false;
+
+    auto it = std::find_if(entries_.begin(), entries_.end(),
+        [&key](const Entry& entry) { return entry.key == key; });
+    if (it != entries_.end()) {
+        entries_.splice(entries_.begin(), entries_, it);
+        stats_.hits += 1;
+        return entries_.front().scene.get();
+    }
+
+    auto scene = loader();
+    if (!scene)
+        return nullptr;
+
+    if (loaded)
+        *loaded = true;
+    stats_.loads += 1;
+
+    auto bytes = scene->memoryBytes();
+    entries_.push_front({ key, std::move(scene), bytes });
+    stats_.bytes += bytes;
+
+    while (stats_.bytes > maxBytes_ && entries_.size() > 1) {
+        stats_.bytes -= entries_.back().bytes;
+        entries_.pop_back();
+        stats_.evictions += 1;
+    }
+    return entries_.front().scene.get();
+}
+
+bool RenderServer::listen(const std::string& address)
+{
+    return listener_.listen(address);
+}
+
+void RenderServer::serve(const Handler& handler)
+{
+    for (;;) {
+        Socket client;
+        if (!listener_.accept(&client, 1.0))
+            continue;
+
+        client.setReceiveTimeout(clientTimeout);
+        if (!serveClient(client, handler))
+            return;
+    }
+}
+
+bool RenderServer::serveClient(Socket& client, const Handler& handler)
+{
+    uint32_t type;
+    std::vector<char> payload;
+    std::vector<char> image;
+    while (receiveMessage(client, &type, &payload)) {
+        if (type == StopMessage)
+            return false;
+        if (type != RequestMessage)
+            break;
+
+        std::vector<std::string> arguments;
+        for (auto begin = payload.begin(); begin != payload.end();) {
+            auto end = std::find(begin, payload.end(), '\0');
+            arguments.emplace_back(begin, end);
+            begin = end == payload.end() ? end : end + 1;
+        }
+
+        std::string log;
+        image.clear();
+        bool sent;
+        if (handler(arguments, &log, &image)) {
+            sent = sendMessage(client, LogMessage, log.data(), log.size())
+                && sendMessage(client, ImageMessage, image.data(), image.size());
+        } else {
+            sent = sendMessage(client, ErrorMessage, log.data(), log.size());
+        }
+
+        if (!sent)
+            break;
+    }
+    return true;
+}
+
+bool requestRender(const std::string& address,
+    const std::vector<std::string>& arguments, std::string* log,
+    std::vector<char>* image)
+{
+    Socket socket;
+    if (!socket.connect(address)) {
+        *log = "Can't connect to " + address;
+        return false;
+    }
+
+    std::vector<char> request;
+    for (const auto& argument : arguments) {
+        request.insert(request.end(), argument.begin(), argument.end());
+        request.push_back('\0');
+    }
+
+    uint32_t type;
+    std::vector<char> payload;
+    if (!sendMessage(socket, RequestMessage, request.data(), request.size())
+        || !receiveMessage(socket, &type, &payload)) {
+        *log = "Connection to " + address + " lost";
+        return false;
+    }
+
+    log->assign(payload.begin(), payload.end());
+    if (type != LogMessage)
+        return false;
+
+    if (!receiveMessage(socket, &type, image) || type != ImageMessage) {
+        *log = "Connection to " + address + " lost";
+        return false;
+    }
+    return true;
+}
+
+bool requestStop(const std::string& address)
+{
+    Socket socket;
+    return socket.connect(address) && sendMessage(socket, StopMessage, nullptr, 0);
+}
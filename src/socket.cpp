@@ -0,0 +1,321 @@
+#include "socket.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// Writes to a closed connection fail instead of raising SIGPIPE
+#if defined(MSG_NOSIGNAL)
+constexpr int sendFlags = MSG_NOSIGNAL;
+#else
+constexpr int sendFlags = 0;
+#endif
+
+constexpr const char* unixPrefix = "unix:";
+// Largest message accepted, guards against garbage sizes
+constexpr uint32_t maxMessageSize = 1u << 30;
+
+struct MessageHeader {
+    uint32_t type;
+    uint32_t size;
+};
+
+bool isUnixAddress(const std::string& address)
+{
+    return address.compare(0, std::strlen(unixPrefix), unixPrefix) == 0;
+}
+
+bool unixSocketAddress(const std::string& address, sockaddr_un* addr)
+{
+    auto path = address.substr(std::strlen(unixPrefix));
+    std::memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+        printf("Invalid socket path: %s\n", path.c_str());
+        return false;
+    }
+    std::memcpy(addr->sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// Removes the socket file a listener that is gone left behind. Fails if the
+// path is another kind of file or a listener still answers on it.
+bool removeStaleSocket(const std::string& address, const sockaddr_un& addr)
+{
+    struct stat info;
+    if (lstat(addr.sun_path, &info) != 0)
+        return errno == ENOENT;
+
+    if (!S_ISSOCK(info.st_mode)) {
+        printf("Can't listen on %s: the path exists and is not a socket\n",
+            address.c_str());
+        return false;
+    }
+
+    auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    auto live = fd >= 0
+        && ::connect(fd, (const sockaddr*)&addr, sizeof(addr)) == 0;
+    if (fd >= 0)
+        ::close(fd);
+    if (live) {
+        printf("Can't listen on %s: another process is listening on it\n",
+            address.c_str());
+        return false;
+    }
+    unlink(addr.sun_path);
+    return true;
+}
+
+// Resolves "<host>:<port>", an empty host listens on every interface
+addrinfo* resolve(const std::string& address, bool passive)
+{
+    auto colon = address.find_last_of(':');
+    if (colon == std::string::npos) {
+        printf("Invalid address, expected host:port or unix:path: %s\n",
+            address.c_str());
+        return nullptr;
+    }
+
+    auto host = address.substr(0, colon);
+    auto port = address.substr(colon + 1);
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+    addrinfo* result = nullptr;
+    auto error = getaddrinfo(host.empty() ? nullptr : host.c_str(),
+        port.c_str(), &hints, &result);
+    if (error != 0) {
+        printf("Can't resolve %s: %s\n", address.c_str(), gai_strerror(error));
+        return nullptr;
+    }
+    return result;
+}
+
+// Small messages go out right away
+void setNoDelay(int fd)
+{
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+} // anonymous namespace
+
+Socket::Socket(Socket&& move)
+    : fd_(move.fd_)
+    , unixPath_(std::move(move.unixPath_))
+{
+    move.fd_ = -1;
+    move.unixPath_.clear();
+}
+
+Socket& Socket::operator=(Socket&& move)
+{
+    if (this != &move) {
+        close();
+        fd_ = move.fd_;
+        unixPath_ = std::move(move.unixPath_);
+        move.fd_ = -1;
+        move.unixPath_.clear();
+    }
+    return *this;
+}
+
+bool Socket::listen(const std::string& address)
+{
+    close();
+
+    if (isUnixAddress(address)) {
+        sockaddr_un addr;
+        if (!unixSocketAddress(address, &addr)
+            || !removeStaleSocket(address, addr)) {
+            return false;
+        }
+
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd_ < 0 || bind(fd_, (sockaddr*)&addr, sizeof(addr)) != 0
+            || ::listen(fd_, SOMAXCONN) != 0) {
+            printf("Can't listen on %s: %s\n", address.c_str(),
+                std::strerror(errno));
+            close();
+            return false;
+        }
+        unixPath_ = addr.sun_path;
+        return true;
+    }
+
+    auto* addresses = resolve(address, true);
+    for (auto* ai = addresses; ai; ai = ai->ai_next) {
+        fd_ = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd_ < 0)
+            continue;
+
+        int reuse = 1;
+        setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd_, ai->ai_addr, ai->ai_addrlen) == 0
+            && ::listen(fd_, SOMAXCONN) == 0) {
+            break;
+        }
+        close();
+    }
+
+    if (addresses)
+        freeaddrinfo(addresses);
+
+    if (fd_ < 0) {
+        printf("Can't listen on %s: %s\n", address.c_str(), std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool Socket::connect(const std::string& address)
+{
+    close();
+
+    if (isUnixAddress(address)) {
+        sockaddr_un addr;
+        if (!unixSocketAddress(address, &addr))
+            return false;
+
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd_ < 0 || ::connect(fd_, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            printf("Can't connect to %s: %s\n", address.c_str(),
+                std::strerror(errno));
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    auto* addresses = resolve(address, false);
+    for (auto* ai = addresses; ai; ai = ai->ai_next) {
+        fd_ = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd_ < 0)
+            continue;
+
+        if (::connect(fd_, ai->ai_addr, ai->ai_addrlen) == 0) {
+            setNoDelay(fd_);
+            break;
+        }
+        close();
+    }
+
+    if (addresses)
+        freeaddrinfo(addresses);
+
+    if (fd_ < 0) {
+        printf("Can't connect to %s: %s\n", address.c_str(), std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool Socket::accept(Socket* client, double timeoutSeconds)
+{
+    pollfd pfd = { fd_, POLLIN, 0 };
+    if (poll(&pfd, 1, (int)(timeoutSeconds * 1000.0)) <= 0)
+        return false;
+
+    auto fd = ::accept(fd_, nullptr, nullptr);
+    if (fd < 0)
+        return false;
+
+    if (unixPath_.empty())
+        setNoDelay(fd);
+
+    client->close();
+    client->fd_ = fd;
+    return true;
+}
+
+bool Socket::send(const void* data, size_t size)
+{
+    auto bytes = (const char*)data;
+    while (size > 0) {
+        auto sent = ::send(fd_, bytes, size, sendFlags);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        bytes += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+bool Socket::receive(void* data, size_t size)
+{
+    auto bytes = (char*)data;
+    while (size > 0) {
+        auto received = ::recv(fd_, bytes, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        bytes += received;
+        size -= (size_t)received;
+    }
+    return true;
+}
+
+bool Socket::setReceiveTimeout(double seconds)
+{
+    timeval timeout;
+    timeout.tv_sec = (time_t)seconds;
+    timeout.tv_usec = (suseconds_t)((seconds - std::floor(seconds)) * 1e6);
+    return setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+        sizeof(timeout)) == 0;
+}
+
+void Socket::shutdown()
+{
+    if (fd_ >= 0)
+        ::shutdown(fd_, SHUT_RDWR);
+}
+
+void Socket::close()
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+
+    if (!unixPath_.empty())
+        unlink(unixPath_.c_str());
+    unixPath_.clear();
+}
+
+bool sendMessage(Socket& socket, uint32_t type, const void* data, size_t size)
+{
+    MessageHeader header = { type, (uint32_t)size };
+    return socket.send(&header, sizeof(header))
+        && (size == 0 || socket.send(data, size));
+}
+
+bool receiveMessage(Socket& socket, uint32_t* type, std::vector<char>* payload)
+{
+    MessageHeader header;
+    if (!socket.receive(&header, sizeof(header)) || header.size > maxMessageSize)
+        return false;
+
+    *type = header.type;
+    payload->resize(header.size);
+    return header.size == 0 || socket.receive(payload->data(), header.size);
+}
@@ -0,0 +1,168 @@
+#include "tile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#include "constants.h"
+
+// methods internal to the file
+namespace {
+
+uint32_t nextPowerOfTwo(uint32_t v)
+{
+    uint32_t result = 1;
+    while (result < v)
+        result <<= 1;
+    return result;
+}
+
+// Spread lower 16 bits of v, so that there is a zero bit between each of them
+uint32_t spreadBits(uint32_t v)
+{
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+uint32_t mortonIndex(uint32_t x, uint32_t y)
+{
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+// Distance of (x, y) along the hilbert curve filling n x n grid, n has to be
+// a power of two
+uint32_t hilbertIndex(uint32_t n, uint32_t x, uint32_t y)
+{
+    uint32_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+
+        // rotate the quadrant
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+// Key ordering tiles in rings around the centre of the grid, each ring walked
+// by the angle around the centre
+float spiralKey(const Vector2i& grid, const Vector2i& index)
+{
+    float dx = (index.x + 0.5f) - grid.x * 0.5f;
+    float dy = (index.y + 0.5f) - grid.y * 0.5f;
+    float ring = std::floor(std::max(std::abs(dx), std::abs(dy)));
+    // atan2 is in [-pi, pi], scale to [0, 1) so it never crosses into the
+    // next ring
+    float angle = (std::atan2(dy, dx) + PI) * INV_2PI;
+    return ring + std::min(angle, 0.999f);
+}
+
+} // anonymous namespace
+
+const char* tileOrderName(TileOrder order)
+{
+    switch (order) {
+    case TileOrder::ColumnMajor:    return "column";
+    case TileOrder::Morton:         return "morton";
+    case TileOrder::Hilbert:        return "hilbert";
+    case TileOrder::Spiral:         return "spiral";
+    case TileOrder::CostSorted:     return "cost";
+    }
+    return "unknown";
+}
+
+bool parseTileOrder(const char* name, TileOrder* order)
+{
+    static const TileOrder orders[] = {
+        TileOrder::ColumnMajor,
+        TileOrder::Morton,
+        TileOrder::Hilbert,
+        TileOrder::Spiral,
+        TileOrder::CostSorted,
+    };
+
+    for (auto o : orders) {
+        if (std::strcmp(name, tileOrderName(o)) == 0) {
+            *order = o;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<Tile> makeTiles(const Vector2i& resolution, int32_t tileSize,
+    TileOrder order, const std::vector<float>& costs)
+{
+    auto grid = tileGridSize(resolution, tileSize);
+
+    std::vector<Tile> tiles;
+    tiles.reserve(grid.x * grid.y);
+
+    // Column major is the natural generation order
+    for (auto i = 0; i < grid.x; ++i) {
+        for (auto j = 0; j < grid.y; ++j) {
+            Vector2i start(i * tileSize, j * tileSize);
+            Vector2i end(
+                std::min((i + 1) * tileSize, resolution.x),
+                std::min((j + 1) * tileSize, resolution.y));
+            tiles.emplace_back(start, end, Vector2i(i, j));
+        }
+    }
+
+    if (order == TileOrder::CostSorted
+        && costs.size() != static_cast<size_t>(grid.x * grid.y)) {
+        order = TileOrder::Hilbert;
+    }
+
+    std::vector<std::pair<double, size_t>> keys;
+    keys.reserve(tiles.size());
+
+    auto n = nextPowerOfTwo((uint32_t)std::max(grid.x, grid.y));
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        const auto& idx = tiles[i].index;
+        double key = 0.0;
+        switch (order) {
+        case TileOrder::ColumnMajor:
+            key = (double)i;
+            break;
+        case TileOrder::Morton:
+            key = (double)mortonIndex(idx.x, idx.y);
+            break;
+        case TileOrder::Hilbert:
+            key = (double)hilbertIndex(n, idx.x, idx.y);
+            break;
+        case TileOrder::Spiral:
+            key = spiralKey(grid, idx);
+            break;
+        case TileOrder::CostSorted:
+            // Negate, so that the most expensive tiles come first
+            key = -costs[idx.y * grid.x + idx.x];
+            break;
+        }
+        keys.emplace_back(key, i);
+    }
+
+    // Stable, so that tiles with equal cost stay in column major order
+    std::stable_sort(begin(keys), end(keys),
+        [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+
+    std::vector<Tile> ordered;
+    ordered.reserve(tiles.size());
+    for (const auto& key : keys) {
+        ordered.push_back(tiles[key.second]);
+    }
+
+    return ordered;
+}